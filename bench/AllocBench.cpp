@@ -0,0 +1,154 @@
+// Steady-state allocation benchmark: ping-pong and broadcast over loopback,
+// measured with the counting operator new of AllocCounter.h against the
+// budgets below.
+//
+//     qlexnet_alloc_bench [messages]
+//
+// Prints allocations and bytes per message of each workload and exits
+// non-zero if one is over budget.
+
+#define QLEXNET_COUNT_ALLOCATIONS
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <qlexnet.h>
+
+namespace qlexnet
+{
+    // Budgets, in allocations per delivered message. Ping-pong recycles
+    // every body and queue block, so it must not allocate at all. A
+    // broadcast encodes one SharedFrame (its bytes and their control block)
+    // that every client's tx queue shares: two allocations per broadcast,
+    // spread over the clients receiving it.
+    constexpr double pingPongBudget = 0.0;
+    constexpr size_t broadcastClients = 8;
+    constexpr double broadcastBudget = 2.0 / broadcastClients;
+
+    enum class BenchMsg : uint32_t
+    {
+        Ping,
+        Broadcast
+    };
+
+    class EchoServer : public ServerInterface<BenchMsg>
+    {
+    public:
+        using ServerInterface<BenchMsg>::ServerInterface;
+
+    protected:
+        bool onClientConnect(std::shared_ptr<Connection<BenchMsg>> client_) override
+        {
+            return true;
+        }
+
+        // Echo with the received body, which returns to the pool once written
+        void onMessage(std::shared_ptr<Connection<BenchMsg>> client_, Message<BenchMsg> &msg_) override
+        {
+            messageClient(client_, std::move(msg_));
+        }
+    };
+
+    // Server handlers run from update(), clients are polled
+    bool awaitReply(EchoServer &server_, ClientInterface<BenchMsg> &client_)
+    {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (client_.incoming().empty())
+        {
+            server_.update(-1, false);
+            if (std::chrono::steady_clock::now() > deadline)
+                return false;
+        }
+        OwnedMessage<BenchMsg> reply = client_.incoming().pop_front();
+        client_.recycle(reply.msg);
+        return true;
+    }
+
+    bool pingPong(EchoServer &server_, ClientInterface<BenchMsg> &client_, size_t count_)
+    {
+        for (size_t i = 0; i < count_; i++)
+        {
+            MessageLease<BenchMsg> msg = client_.acquireMessage(BenchMsg::Ping, 64);
+            for (uint32_t k = 0; k < 16; k++)
+                *msg << k;
+            client_.send(msg.take());
+            if (!awaitReply(server_, client_))
+                return false;
+        }
+        return true;
+    }
+
+    bool broadcast(EchoServer &server_, std::vector<std::unique_ptr<ClientInterface<BenchMsg>>> &clients_, size_t count_)
+    {
+        for (size_t i = 0; i < count_; i++)
+        {
+            {
+                MessageLease<BenchMsg> msg = server_.acquireMessage(BenchMsg::Broadcast, 64);
+                for (uint32_t k = 0; k < 16; k++)
+                    *msg << k;
+                server_.messageAllClients(*msg);
+            }
+            for (auto &client : clients_)
+            {
+                if (!awaitReply(server_, *client))
+                    return false;
+            }
+        }
+        return true;
+    }
+} // qlexnet
+
+int main(int argc, char **argv)
+{
+    using namespace qlexnet;
+
+    const size_t messages = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 20000;
+    const uint16_t port = 60791;
+    // Warm-up rounds grow pools, queues and handler memory to their working size
+    const size_t warmUp = 2000;
+
+    EchoServer server(port);
+    if (!server.start())
+        return EXIT_FAILURE;
+
+    std::vector<std::unique_ptr<ClientInterface<BenchMsg>>> clients;
+    for (size_t i = 0; i < broadcastClients; i++)
+    {
+        clients.push_back(std::make_unique<ClientInterface<BenchMsg>>());
+        clients.back()->connect("127.0.0.1", port);
+        if (!clients.back()->waitConnected(std::chrono::seconds(5)))
+        {
+            std::cout << "FAILED: client " << i << " could not connect\n";
+            return EXIT_FAILURE;
+        }
+    }
+    // An echo proves the server has registered that client
+    bool ok = true;
+    for (auto &client : clients)
+        ok = ok && pingPong(server, *client, 1);
+
+    ok = ok && pingPong(server, *clients[0], warmUp);
+    AllocProbe pingPongProbe("ping-pong", pingPongBudget);
+    pingPongProbe.start();
+    ok = ok && pingPong(server, *clients[0], messages);
+    ok = pingPongProbe.finish(messages) && ok;
+
+    const size_t broadcasts = messages / broadcastClients;
+    ok = broadcast(server, clients, warmUp / broadcastClients) && ok;
+    AllocProbe broadcastProbe("broadcast", broadcastBudget);
+    broadcastProbe.start();
+    ok = broadcast(server, clients, broadcasts) && ok;
+    ok = broadcastProbe.finish(broadcasts * broadcastClients) && ok;
+
+    for (auto &client : clients)
+        client->disconnect();
+    server.stop();
+
+    if (!ok)
+        std::cout << "FAILED: over budget or messages lost\n";
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
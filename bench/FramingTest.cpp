@@ -0,0 +1,159 @@
+// Receive framing check: frames written over a raw socket in pieces that
+// do not line up with frame boundaries must come out of the server whole.
+//
+//     qlexnet_framing_test
+//
+// Covers a frame dribbled out a few bytes at a time, one that grows the
+// receive buffer, one larger than the buffer limit followed in the same
+// write by a small one, and a burst of frames in a single write. Exits
+// non-zero if any frame is lost, reordered or corrupted.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <qlexnet.h>
+
+namespace qlexnet
+{
+    enum class FrameMsg : uint32_t
+    {
+        Data
+    };
+
+    // Small enough that the oversized frame takes the direct body read
+    constexpr size_t readBufferLimit = 16 * 1024;
+
+    class CollectServer : public ServerInterface<FrameMsg>
+    {
+    public:
+        using ServerInterface<FrameMsg>::ServerInterface;
+
+        std::vector<std::vector<uint8_t>> received;
+
+    protected:
+        bool onClientConnect(std::shared_ptr<Connection<FrameMsg>> client_) override
+        {
+            return true;
+        }
+
+        void onMessage(std::shared_ptr<Connection<FrameMsg>> client_, Message<FrameMsg> &msg_) override
+        {
+            received.emplace_back(msg_.body.begin(), msg_.body.end());
+        }
+    };
+
+    // Body bytes depend on the frame's index, so a mix-up between frames shows
+    std::vector<uint8_t> makeBody(size_t index_, size_t size_)
+    {
+        std::vector<uint8_t> body(size_);
+        for (size_t i = 0; i < size_; i++)
+            body[i] = static_cast<uint8_t>(i * 31 + index_ * 7 + 1);
+        return body;
+    }
+
+    void appendFrame(std::vector<uint8_t> &wire_, const std::vector<uint8_t> &body_)
+    {
+        MessageHeader<FrameMsg> header;
+        header.id = FrameMsg::Data;
+        header.size = static_cast<uint32_t>(body_.size());
+
+        const size_t at = wire_.size();
+        wire_.resize(at + sizeof(header) + body_.size());
+        std::memcpy(wire_.data() + at, &header, sizeof(header));
+        if (!body_.empty())
+            std::memcpy(wire_.data() + at + sizeof(header), body_.data(), body_.size());
+    }
+
+    // Write in chunk_-sized pieces with a pause between them, so the server
+    // sees them as separate reads
+    void writeChunked(asio::ip::tcp::socket &socket_, const std::vector<uint8_t> &wire_, size_t chunk_)
+    {
+        for (size_t at = 0; at < wire_.size(); at += chunk_)
+        {
+            asio::write(socket_, asio::buffer(wire_.data() + at, std::min(chunk_, wire_.size() - at)));
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+} // qlexnet
+
+int main()
+{
+    using namespace qlexnet;
+
+    const uint16_t port = 60792;
+
+    CollectServer server(port);
+    server.setReadBufferSize(readBufferLimit);
+    if (!server.start())
+        return EXIT_FAILURE;
+
+    std::vector<std::vector<uint8_t>> sent;
+    asio::io_context context;
+    asio::ip::tcp::socket socket(context);
+    try
+    {
+        socket.connect(asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), port));
+        socket.set_option(asio::ip::tcp::no_delay(true));
+
+        // Header and body split a few bytes at a time
+        std::vector<uint8_t> wire;
+        sent.push_back(makeBody(sent.size(), 100));
+        appendFrame(wire, sent.back());
+        writeChunked(socket, wire, 7);
+
+        // Larger than the initial buffer, within the limit
+        wire.clear();
+        sent.push_back(makeBody(sent.size(), 12 * 1024));
+        appendFrame(wire, sent.back());
+        writeChunked(socket, wire, 1000);
+
+        // Over the limit, with a small frame right behind it
+        wire.clear();
+        sent.push_back(makeBody(sent.size(), 100 * 1024));
+        appendFrame(wire, sent.back());
+        sent.push_back(makeBody(sent.size(), 20));
+        appendFrame(wire, sent.back());
+        writeChunked(socket, wire, 5000);
+
+        // Many frames in a single write, empty bodies included
+        wire.clear();
+        for (size_t i = 0; i < 200; i++)
+        {
+            sent.push_back(makeBody(sent.size(), (i * 37) % 300));
+            appendFrame(wire, sent.back());
+        }
+        asio::write(socket, asio::buffer(wire));
+    }
+    catch (std::exception &e)
+    {
+        std::cout << "FAILED: " << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (server.received.size() < sent.size() && std::chrono::steady_clock::now() < deadline)
+        server.update(-1, false);
+
+    bool ok = server.received.size() == sent.size();
+    for (size_t i = 0; ok && i < sent.size(); i++)
+    {
+        if (server.received[i] != sent[i])
+        {
+            std::cout << "FAILED: frame " << i << " arrived corrupted\n";
+            ok = false;
+        }
+    }
+    if (server.received.size() != sent.size())
+        std::cout << "FAILED: " << server.received.size() << " of " << sent.size() << " frames arrived\n";
+    else if (ok)
+        std::cout << sent.size() << " frames arrived intact\n";
+
+    socket.close();
+    server.stop();
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
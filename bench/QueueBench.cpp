@@ -0,0 +1,91 @@
+// Rx queue benchmark: XQueue against MPSCQueue with 1..8 producer threads
+// pushing into one consumer, the way io threads feed a server's rx queue.
+//
+//     qlexnet_queue_bench [itemsPerProducer]
+//
+// Prints the throughput of each queue and exits non-zero if any item was
+// lost or a producer's items came out of order.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <qlexnet.h>
+
+namespace qlexnet
+{
+    struct BenchItem
+    {
+        uint32_t producer = 0;
+        uint32_t sequence = 0;
+    };
+
+    // Runs one producer/consumer round, returns items per second or a
+    // negative value if the consumer saw a wrong count or order
+    template <typename Queue>
+    double runQueueBench(size_t producers_, size_t itemsPerProducer_)
+    {
+        Queue queue;
+        std::vector<std::thread> producers;
+        const size_t total = producers_ * itemsPerProducer_;
+
+        const auto start = std::chrono::steady_clock::now();
+        for (size_t p = 0; p < producers_; p++)
+        {
+            producers.emplace_back([&queue, p, itemsPerProducer_]()
+                                   {
+                                       for (size_t i = 0; i < itemsPerProducer_; i++)
+                                           queue.push_back(BenchItem{static_cast<uint32_t>(p), static_cast<uint32_t>(i)}); });
+        }
+
+        std::vector<uint32_t> next(producers_, 0);
+        std::vector<BenchItem> batch;
+        batch.reserve(4096);
+        size_t received = 0;
+        bool ordered = true;
+        while (received < total)
+        {
+            queue.wait_for(std::chrono::milliseconds(100));
+            batch.clear();
+            received += queue.drain_into(batch, 4096);
+            for (const BenchItem &item : batch)
+                ordered &= (item.sequence == next[item.producer]++);
+        }
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+
+        for (auto &producer : producers)
+            producer.join();
+
+        if (!ordered || !queue.empty())
+            return -1.0;
+        return static_cast<double>(total) / std::chrono::duration<double>(elapsed).count();
+    }
+} // qlexnet
+
+int main(int argc, char **argv)
+{
+    using namespace qlexnet;
+
+    const size_t itemsPerProducer = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    bool ok = true;
+
+    std::cout << "producers        XQueue     MPSCQueue   (Mitems/s, " << itemsPerProducer << " items per producer)\n";
+    for (size_t producers : {1, 2, 4, 8})
+    {
+        const double locked = runQueueBench<XQueue<BenchItem>>(producers, itemsPerProducer);
+        const double lockFree = runQueueBench<MPSCQueue<BenchItem>>(producers, itemsPerProducer);
+        ok &= locked > 0 && lockFree > 0;
+
+        std::cout << std::setw(9) << producers << std::fixed << std::setprecision(2)
+                  << std::setw(14) << locked / 1e6 << std::setw(14) << lockFree / 1e6 << "\n";
+    }
+
+    if (!ok)
+        std::cout << "FAILED: items lost or reordered\n";
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,167 @@
+// Coroutine benchmark: a session-mode server echoing from onSession(), and
+// a client driven by coroutines on its executor, over loopback.
+//
+//     qlexnet_session_bench [messages]
+//
+// Runs ping-pong (send, then co_await the reply) and a stream (every
+// message queued up front, then a receive loop co_awaiting the replies).
+// Prints the rate of each and exits non-zero if a reply is lost, reordered
+// or an operation fails. Needs C++20 coroutines.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <future>
+#include <iostream>
+
+#include <qlexnet.h>
+
+#if !defined(ASIO_HAS_CO_AWAIT)
+#error "qlexnet_session_bench needs a compiler with C++20 coroutines"
+#endif
+
+namespace qlexnet
+{
+    enum class SessionMsg : uint32_t
+    {
+        Echo
+    };
+
+    class SessionServer : public ServerInterface<SessionMsg>
+    {
+    public:
+        using ServerInterface<SessionMsg>::ServerInterface;
+
+        ~SessionServer() override { stop(); }
+
+    protected:
+        bool onClientConnect(std::shared_ptr<Connection<SessionMsg>> client_) override
+        {
+            return true;
+        }
+
+        // Echo every message back, in order, until the connection goes
+        asio::awaitable<void> onSession(std::shared_ptr<Connection<SessionMsg>> client_) override
+        {
+            for (;;)
+            {
+                auto [ec, msg] = co_await client_->async_receive(asio::as_tuple(asio::deferred));
+                if (ec)
+                    co_return;
+                auto [sendEc] = co_await client_->async_send(std::move(msg), asio::as_tuple(asio::deferred));
+                if (sendEc)
+                    co_return;
+            }
+        }
+    };
+
+    Message<SessionMsg> makeEcho(uint32_t sequence_)
+    {
+        Message<SessionMsg> msg;
+        msg.header.id = SessionMsg::Echo;
+        msg << sequence_;
+        return msg;
+    }
+
+    // Number of replies that came back with the expected sequence
+    asio::awaitable<size_t> pingPong(ClientInterface<SessionMsg> &client_, uint32_t count_)
+    {
+        size_t good = 0;
+        for (uint32_t i = 0; i < count_; i++)
+        {
+            auto [sendEc] = co_await client_.async_send(makeEcho(i), asio::as_tuple(asio::deferred));
+            auto [ec, reply] = co_await client_.async_receive(asio::as_tuple(asio::deferred));
+            if (sendEc || ec)
+                co_return good;
+
+            uint32_t sequence = 0;
+            reply >> sequence;
+            if (sequence == i)
+                good++;
+        }
+        co_return good;
+    }
+
+    asio::awaitable<size_t> receiveLoop(ClientInterface<SessionMsg> &client_, uint32_t count_)
+    {
+        size_t good = 0;
+        for (uint32_t i = 0; i < count_; i++)
+        {
+            auto [ec, reply] = co_await client_.async_receive(asio::as_tuple(asio::deferred));
+            if (ec)
+                co_return good;
+
+            uint32_t sequence = 0;
+            reply >> sequence;
+            if (sequence == i)
+                good++;
+        }
+        co_return good;
+    }
+
+    // Queue every message at once, then collect the replies while the
+    // connection is still writing
+    asio::awaitable<size_t> stream(ClientInterface<SessionMsg> &client_, uint32_t count_)
+    {
+        for (uint32_t i = 0; i < count_; i++)
+            client_.send(makeEcho(i));
+
+        co_return co_await receiveLoop(client_, count_);
+    }
+
+    // Run a workload on the client's io thread and report it
+    template <typename Workload>
+    bool run(const char *name_, ClientInterface<SessionMsg> &client_, Workload workload_, uint32_t count_)
+    {
+        std::promise<size_t> done;
+        const auto start = std::chrono::steady_clock::now();
+        asio::co_spawn(client_.executor(), workload_(client_, count_),
+                       [&done](std::exception_ptr e_, size_t good_)
+                       { done.set_value(e_ ? 0 : good_); });
+
+        std::future<size_t> result = done.get_future();
+        if (result.wait_for(std::chrono::seconds(10)) != std::future_status::ready)
+        {
+            std::cout << "FAILED: " << name_ << " timed out\n";
+            return false;
+        }
+        const size_t good = result.get();
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << name_ << ": " << good << " of " << count_ << " replies, "
+                  << static_cast<double>(good) / seconds / 1000.0 << " kmsg/s\n";
+        return good == count_;
+    }
+} // qlexnet
+
+int main(int argc, char **argv)
+{
+    using namespace qlexnet;
+
+    const uint32_t messages = (argc > 1) ? static_cast<uint32_t>(std::strtoul(argv[1], nullptr, 10)) : 20000;
+    const uint16_t port = 60793;
+
+    SessionServer server(port);
+    server.setSessionMode(true);
+    if (!server.start())
+        return EXIT_FAILURE;
+
+    ClientInterface<SessionMsg> client;
+    client.setAsyncReceive(true);
+    client.connect("127.0.0.1", port);
+    if (!client.waitConnected(std::chrono::seconds(5)))
+    {
+        std::cout << "FAILED: could not connect\n";
+        return EXIT_FAILURE;
+    }
+
+    bool ok = run("ping-pong", client, pingPong, messages);
+    ok = run("stream", client, stream, messages) && ok;
+
+    client.disconnect();
+    server.stop();
+
+    if (!ok)
+        std::cout << "FAILED: replies lost or out of order\n";
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
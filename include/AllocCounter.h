@@ -0,0 +1,251 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory_resource>
+#include <new>
+#include <string>
+
+namespace qlexnet
+{
+    struct AllocStats
+    {
+        uint64_t allocations = 0;
+        uint64_t bytes = 0;
+        uint64_t frees = 0;
+    };
+
+    // Allocation counters. global() is fed by the operator new replacement
+    // below; each CountingResource has its own, so allocations can be told
+    // apart by path without counting them twice.
+    class AllocCounter
+    {
+    public:
+        constexpr AllocCounter() = default;
+        AllocCounter(const AllocCounter &) = delete;
+
+        // Constant-initialized, so operator new can use it during static
+        // initialization
+        static AllocCounter &global()
+        {
+            static AllocCounter counter;
+            return counter;
+        }
+
+        // Whether global() is fed at all, i.e. some translation unit defines
+        // QLEXNET_COUNT_ALLOCATIONS. Set during static initialization.
+        static bool globalHooked()
+        {
+            return hookFlag().load(std::memory_order_acquire);
+        }
+
+        static void markGlobalHooked()
+        {
+            hookFlag().store(true, std::memory_order_release);
+        }
+
+        void recordAlloc(size_t size_)
+        {
+            _allocations.fetch_add(1, std::memory_order_relaxed);
+            _bytes.fetch_add(size_, std::memory_order_relaxed);
+        }
+
+        void recordFree()
+        {
+            _frees.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        AllocStats snapshot() const
+        {
+            AllocStats stats;
+            stats.allocations = _allocations.load(std::memory_order_relaxed);
+            stats.bytes = _bytes.load(std::memory_order_relaxed);
+            stats.frees = _frees.load(std::memory_order_relaxed);
+            return stats;
+        }
+
+    private:
+        static std::atomic<bool> &hookFlag()
+        {
+            static std::atomic<bool> flag{false};
+            return flag;
+        }
+
+        std::atomic<uint64_t> _allocations{0};
+        std::atomic<uint64_t> _bytes{0};
+        std::atomic<uint64_t> _frees{0};
+    };
+
+    // Memory resource counting what it passes on to upstream_. Give it to a
+    // server or client to see what goes to their resource: containers,
+    // pmr bodies, and completion handlers that do not fit their
+    // connection's HandlerMemory.
+    class CountingResource : public std::pmr::memory_resource
+    {
+    public:
+        explicit CountingResource(std::pmr::memory_resource *upstream_ = std::pmr::get_default_resource())
+            : _upstream(upstream_)
+        {
+        }
+
+        AllocCounter &counter() { return _counter; }
+
+    protected:
+        void *do_allocate(size_t bytes_, size_t align_) override
+        {
+            _counter.recordAlloc(bytes_);
+            return _upstream->allocate(bytes_, align_);
+        }
+
+        void do_deallocate(void *p_, size_t bytes_, size_t align_) override
+        {
+            _counter.recordFree();
+            _upstream->deallocate(p_, bytes_, align_);
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource &other_) const noexcept override
+        {
+            return this == &other_;
+        }
+
+    private:
+        std::pmr::memory_resource *_upstream;
+        AllocCounter _counter;
+    };
+
+    // Measures one workload against an allocation budget:
+    //
+    //     AllocProbe probe("ping-pong", 0.0);
+    //     probe.start();
+    //     ... exchange n messages ...
+    //     bool ok = probe.finish(n);
+    //
+    // finish() prints allocations and bytes per message and returns false
+    // when either is over budget; a negative budget is not checked. Counts
+    // come from every thread, so keep unrelated work out of the window.
+    // The global counter needs QLEXNET_COUNT_ALLOCATIONS: without it
+    // finish() reports nothing measured and returns false. Pass a
+    // CountingResource's counter() to measure that instead.
+    class AllocProbe
+    {
+    public:
+        explicit AllocProbe(std::string name_, double maxAllocsPerMessage_ = 0.0, double maxBytesPerMessage_ = -1.0,
+                            AllocCounter &counter_ = AllocCounter::global())
+            : _name(std::move(name_)), _maxAllocs(maxAllocsPerMessage_), _maxBytes(maxBytesPerMessage_), _counter(counter_)
+        {
+        }
+
+        void start()
+        {
+            _begin = _counter.snapshot();
+        }
+
+        bool finish(size_t messages_)
+        {
+            if (&_counter == &AllocCounter::global() && !AllocCounter::globalHooked())
+            {
+                std::cout << "[ALLOC] " << _name << ": not measured, define QLEXNET_COUNT_ALLOCATIONS"
+                          << " or pass a counter" << std::endl;
+                return false;
+            }
+
+            const AllocStats end = _counter.snapshot();
+
+            const double messages = static_cast<double>(messages_ ? messages_ : 1);
+            _allocsPerMessage = static_cast<double>(end.allocations - _begin.allocations) / messages;
+            _bytesPerMessage = static_cast<double>(end.bytes - _begin.bytes) / messages;
+
+            const bool ok = (_maxAllocs < 0 || _allocsPerMessage <= _maxAllocs) &&
+                            (_maxBytes < 0 || _bytesPerMessage <= _maxBytes);
+
+            std::cout << "[ALLOC] " << _name << ": " << _allocsPerMessage << " allocs/msg, "
+                      << _bytesPerMessage << " bytes/msg over " << messages_ << " messages"
+                      << (ok ? "" : " - OVER BUDGET") << std::endl;
+            return ok;
+        }
+
+        double allocsPerMessage() const { return _allocsPerMessage; }
+        double bytesPerMessage() const { return _bytesPerMessage; }
+
+    private:
+        std::string _name;
+        double _maxAllocs;
+        double _maxBytes;
+        AllocCounter &_counter;
+        AllocStats _begin;
+        double _allocsPerMessage = 0.0;
+        double _bytesPerMessage = 0.0;
+    };
+} // qlexnet
+
+// Define QLEXNET_COUNT_ALLOCATIONS in exactly one translation unit of a
+// benchmark or test program, before its first qlexnet include, to replace
+// the global operator new/delete with counting versions.
+#if defined(QLEXNET_COUNT_ALLOCATIONS)
+
+namespace qlexnet::detail
+{
+    inline void *countedAlloc(size_t size_)
+    {
+        qlexnet::AllocCounter::global().recordAlloc(size_);
+        if (void *p = std::malloc(size_ ? size_ : 1))
+            return p;
+        throw std::bad_alloc();
+    }
+
+    inline void *countedAlignedAlloc(size_t size_, std::align_val_t align_)
+    {
+        qlexnet::AllocCounter::global().recordAlloc(size_);
+        const size_t align = static_cast<size_t>(align_);
+        // aligned_alloc wants a multiple of the alignment
+        if (void *p = std::aligned_alloc(align, (size_ + align - 1) / align * align))
+            return p;
+        throw std::bad_alloc();
+    }
+
+    // Tells AllocProbe the global counter is live
+    [[maybe_unused]] static const bool countingHookInstalled = (qlexnet::AllocCounter::markGlobalHooked(), true);
+
+    inline void countedFree(void *p_)
+    {
+        if (!p_)
+            return;
+        qlexnet::AllocCounter::global().recordFree();
+        std::free(p_);
+    }
+} // qlexnet::detail
+
+void *operator new(size_t size_) { return qlexnet::detail::countedAlloc(size_); }
+void *operator new[](size_t size_) { return qlexnet::detail::countedAlloc(size_); }
+void *operator new(size_t size_, std::align_val_t align_) { return qlexnet::detail::countedAlignedAlloc(size_, align_); }
+void *operator new[](size_t size_, std::align_val_t align_) { return qlexnet::detail::countedAlignedAlloc(size_, align_); }
+
+void *operator new(size_t size_, const std::nothrow_t &) noexcept
+{
+    try
+    {
+        return qlexnet::detail::countedAlloc(size_);
+    }
+    catch (...)
+    {
+        return nullptr;
+    }
+}
+
+void *operator new[](size_t size_, const std::nothrow_t &tag_) noexcept { return operator new(size_, tag_); }
+
+void operator delete(void *p_) noexcept { qlexnet::detail::countedFree(p_); }
+void operator delete[](void *p_) noexcept { qlexnet::detail::countedFree(p_); }
+void operator delete(void *p_, size_t) noexcept { qlexnet::detail::countedFree(p_); }
+void operator delete[](void *p_, size_t) noexcept { qlexnet::detail::countedFree(p_); }
+void operator delete(void *p_, std::align_val_t) noexcept { qlexnet::detail::countedFree(p_); }
+void operator delete[](void *p_, std::align_val_t) noexcept { qlexnet::detail::countedFree(p_); }
+void operator delete(void *p_, size_t, std::align_val_t) noexcept { qlexnet::detail::countedFree(p_); }
+void operator delete[](void *p_, size_t, std::align_val_t) noexcept { qlexnet::detail::countedFree(p_); }
+void operator delete(void *p_, const std::nothrow_t &) noexcept { qlexnet::detail::countedFree(p_); }
+void operator delete[](void *p_, const std::nothrow_t &) noexcept { qlexnet::detail::countedFree(p_); }
+
+#endif
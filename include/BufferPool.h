@@ -0,0 +1,128 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+#include "SmallBuffer.h"
+
+namespace qlexnet
+{
+    // Free list of byte buffers shared by the connections of a server or
+    // client. Released buffers keep their capacity, so once the pool is
+    // warm message bodies are recycled instead of reallocated.
+    // The free list is split in stripes, each thread going to its own
+    // first, so io threads and consumers rarely contend on the same lock.
+    // Buffer is std::vector<uint8_t>, or std::pmr::vector<uint8_t> to draw
+    // new buffers from a memory resource (see setResource()).
+    template <typename Buffer>
+    class BasicBufferPool
+    {
+    public:
+        explicit BasicBufferPool(size_t maxBuffers_ = 1024, size_t maxCapacity_ = 1024 * 1024, size_t stripes_ = 4)
+            : _stripeCount(std::max<size_t>(stripes_, 1)),
+              _stripes(new Stripe[_stripeCount]),
+              _maxPerStripe(std::max<size_t>((maxBuffers_ + _stripeCount - 1) / _stripeCount, 1)),
+              _maxCapacity(maxCapacity_)
+        {
+            for (size_t i = 0; i < _stripeCount; i++)
+                _stripes[i].free.reserve(_maxPerStripe);
+        }
+
+        BasicBufferPool(const BasicBufferPool &) = delete;
+
+    public:
+        // Where pmr buffers are allocated when the pool is empty. Set it
+        // before first use; the resource must outlive every buffer.
+        void setResource(std::pmr::memory_resource *resource_)
+        {
+            _resource = resource_;
+        }
+
+        // Returns an empty buffer, with spare capacity if one was available.
+        // Other stripes are tried when the caller's own is empty.
+        Buffer acquire()
+        {
+            const size_t home = homeStripe();
+            for (size_t i = 0; i < _stripeCount; i++)
+            {
+                Stripe &stripe = _stripes[(home + i) % _stripeCount];
+                std::scoped_lock<std::mutex> lock(stripe.muxFree);
+                if (!stripe.free.empty())
+                {
+                    Buffer buf = std::move(stripe.free.back());
+                    stripe.free.pop_back();
+                    return buf;
+                }
+            }
+
+            if constexpr (std::is_constructible_v<typename Buffer::allocator_type, std::pmr::memory_resource *>)
+            {
+                if (_resource)
+                    return Buffer(typename Buffer::allocator_type(_resource));
+            }
+            return Buffer();
+        }
+
+        // Hand a buffer back. Oversized buffers and overflow are just freed.
+        void release(Buffer &&buf_)
+        {
+            if (buf_.capacity() == 0 || buf_.capacity() > _maxCapacity)
+                return;
+
+            buf_.clear();
+
+            Stripe &stripe = _stripes[homeStripe()];
+            std::scoped_lock<std::mutex> lock(stripe.muxFree);
+            if (stripe.free.size() < _maxPerStripe)
+                stripe.free.push_back(std::move(buf_));
+        }
+
+        // Only the spilled heap storage of a small buffer is worth keeping
+        template <size_t N>
+        void release(SmallBuffer<N, Buffer> &&buf_)
+        {
+            release(buf_.release());
+        }
+
+        size_t count()
+        {
+            size_t n = 0;
+            for (size_t i = 0; i < _stripeCount; i++)
+            {
+                std::scoped_lock<std::mutex> lock(_stripes[i].muxFree);
+                n += _stripes[i].free.size();
+            }
+            return n;
+        }
+
+    protected:
+        // Threads are numbered once, on their first use of any pool
+        size_t homeStripe() const
+        {
+            static std::atomic<size_t> nextThread{0};
+            thread_local const size_t thread = nextThread++;
+            return thread % _stripeCount;
+        }
+
+        // One cache line each, so neighbouring stripes do not false-share
+        struct alignas(64) Stripe
+        {
+            std::mutex muxFree;
+            std::vector<Buffer> free;
+        };
+
+        size_t _stripeCount;
+        std::unique_ptr<Stripe[]> _stripes;
+        size_t _maxPerStripe;
+        size_t _maxCapacity;
+        std::pmr::memory_resource *_resource = nullptr;
+    };
+
+    using BufferPool = BasicBufferPool<std::vector<uint8_t>>;
+} // qlexnet
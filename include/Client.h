@@ -1,33 +1,50 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <iterator>
+#include <memory_resource>
+#include <mutex>
 #include <ostream>
+#include <random>
+#include <thread>
 
 #include "Message.h"
 #include "XQueue.h"
+#include "MPSCQueue.h"
+#include "Waiter.h"
 #include "Connection.h"
+#include "ConnectionFactory.h"
 
 namespace qlexnet
 {
-    template <typename T>
-    class ClientInterface
+    // RxQueue is the queue policy for incoming messages: XQueue by default,
+    // or MPSCQueue for a lock-free multi-producer rx path.
+    template <typename T, typename RxQueue = XQueue<OwnedMessage<T>>>
+    class ClientInterface : public ConnectionFactory<T>
     {
     public:
-        ClientInterface() {}
+        // resource_, if given, also backs the rx queue (see ConnectionFactory).
+        explicit ClientInterface(std::pmr::memory_resource *resource_ = nullptr)
+            : ConnectionFactory<T>(resource_), _rxQueue(makeQueue<RxQueue>(resource_))
+        {
+        }
         virtual ~ClientInterface() { disconnect(); }
 
     public:
+        // Starts resolving and connecting in the background and returns at
+        // once; onConnect() reports the outcome. Messages sent meanwhile are
+        // held in the send backlog.
         bool connect(const std::string &host_, const uint16_t port_)
         {
             try
             {
-                asio::ip::tcp::resolver resolver(_context);
-                asio::ip::tcp::resolver::results_type endpoints = resolver.resolve(host_, std::to_string(port_));
-
-                // Create connection
-                _connection = std::make_unique<Connection<T>>(Connection<T>::owner::client, _context, asio::ip::tcp::socket(_context), _rxQueue);
-
-                // Tell the connection object to connect to server
-                _connection->connectToServer(endpoints);
+                _host = host_;
+                _port = std::to_string(port_);
+                _stopping = false;
+                startConnect();
 
                 // Start Context Thread
                 thrContext = std::thread([this]()
@@ -43,9 +60,15 @@ namespace qlexnet
 
         void disconnect()
         {
-            if (isConnected())
+            _stopping = true;
             {
-                _connection->disconnect();
+                std::scoped_lock<std::mutex> lock(muxConnection);
+                if (_connection && _connection->isConnected())
+                {
+                    _connection->disconnect();
+                }
+                _connected = false;
+                _backlog.clear();
             }
 
             _context.stop();
@@ -54,44 +77,303 @@ namespace qlexnet
                 thrContext.join();
             }
 
-            _connection.release();
+            _connection.reset();
         }
 
         // Check if client is actually connected to a server
         bool isConnected()
         {
-            if (_connection)
-            {
-                return _connection->isConnected();
-            }
-            return false;
+            return _connected.load(std::memory_order_acquire);
+        }
+
+        // Block until connected, or the timeout expires
+        bool waitConnected(std::chrono::milliseconds timeout_)
+        {
+            _connectWaiter.wait_for([this]()
+                                    { return isConnected(); },
+                                    timeout_);
+            return isConnected();
+        }
+
+        // Reconnect after a failed attempt or a lost connection, waiting
+        // initialDelay_ the first time and doubling up to maxDelay_, each
+        // delay drawn between half and all of its value. Set it before connect().
+        void setReconnect(bool enable_, std::chrono::milliseconds initialDelay_ = std::chrono::milliseconds(100),
+                          std::chrono::milliseconds maxDelay_ = std::chrono::milliseconds(10000))
+        {
+            _reconnect = enable_;
+            _initialDelay = std::max(initialDelay_, std::chrono::milliseconds(1));
+            _maxDelay = std::max(maxDelay_, _initialDelay);
+        }
+
+        // Number of messages held while not connected; 0 drops them instead
+        void setSendBacklog(size_t maxMessages_)
+        {
+            std::scoped_lock<std::mutex> lock(muxConnection);
+            _maxBacklog = maxMessages_;
         }
 
     public:
-        // Send message to server
-        void send(const Message<T> &msg_)
+        // Send message to server. While (re)connecting the message waits in
+        // the backlog; returns false if it was dropped.
+        bool send(const Message<T> &msg_)
         {
-            if (isConnected())
+            return send(Message<T>(msg_));
+        }
+
+        bool send(Message<T> &&msg_)
+        {
+            std::scoped_lock<std::mutex> lock(muxConnection);
+            if (_connected.load(std::memory_order_relaxed))
             {
-                _connection->send(msg_);
+                _connection->send(std::move(msg_));
+                return true;
             }
+
+            if (_stopping || _backlog.size() >= _maxBacklog)
+                return false;
+
+            _backlog.push_back(std::move(msg_));
+            return true;
+        }
+
+        bool emplaceSend(T id_, BodyBuffer<T> &&body_)
+        {
+            Message<T> msg;
+            msg.header.id = id_;
+            msg.header.size = static_cast<uint32_t>(body_.size());
+            adoptBody<T>(msg.body, std::move(body_));
+            return send(std::move(msg));
         }
 
         // Retrieve queue of messages from server
-        XQueue<OwnedMessage<T>> &incoming()
+        RxQueue &incoming()
         {
             return _rxQueue;
         }
 
+        // When enabled, messages from the server skip incoming() and are
+        // passed to onMessageInline() on the io thread. Set it before connect().
+        void setInlineDelivery(bool enable_) { _inlineDelivery = enable_; }
+
+        // When enabled, messages from the server are read with
+        // async_receive() instead of incoming(). Set it before connect().
+        void setAsyncReceive(bool enable_) { _asyncReceive = enable_; }
+
+        // Completion-token based I/O on the connection, e.g. from a coroutine
+        // spawned on executor(): `auto [ec, msg] = co_await client.async_receive(as_tuple(deferred));`
+        // Each operation is bound to the connection current when it is
+        // started; after a reconnect, start a new one.
+        template <typename CompletionToken = asio::deferred_t>
+        auto async_receive(CompletionToken &&token_ = {})
+        {
+            return currentConnection()->async_receive(std::forward<CompletionToken>(token_));
+        }
+
+        template <typename CompletionToken = asio::deferred_t>
+        auto async_send(Message<T> msg_, CompletionToken &&token_ = {})
+        {
+            return currentConnection()->async_send(std::move(msg_), std::forward<CompletionToken>(token_));
+        }
+
+        asio::any_io_executor executor() { return _context.get_executor(); }
+
+    protected:
+        // Called on the io thread for every message when inline delivery is
+        // on. The view is only valid during the call.
+        virtual void onMessageInline(const MessageView<T> &msg_) {}
+
+        // Called on the io thread after every connection attempt, ec_ is set if it failed
+        virtual void onConnect(std::error_code ec_) {}
+        // Called on the io thread when an established connection is lost
+        virtual void onDisconnect(std::error_code ec_) {}
+        // Called on the io thread for each message of the send backlog that
+        // is dropped because the client gave up (re)connecting
+        virtual void onSendDropped(Message<T> &msg_) {}
+
+        // Calls f_(msg) for every message waiting in the send backlog
+        template <typename F>
+        void forEachBacklog(F &&f_)
+        {
+            std::scoped_lock<std::mutex> lock(muxConnection);
+            for (const Message<T> &msg : _backlog)
+                f_(msg);
+        }
+
+    private:
+        // Each attempt gets a fresh connection, the previous one is retired.
+        // The first one is made on the caller's thread, so _connection is
+        // set as soon as connect() returns.
+        void startConnect()
+        {
+            auto conn = this->newConnection(Connection<T>::owner::client, _context, asio::ip::tcp::socket(_context), _rxQueue);
+            if (_asyncReceive)
+                conn->enableAsyncReceive();
+            if (_inlineDelivery)
+                conn->setInlineHandler([this](Connection<T> &, const MessageView<T> &msg)
+                                       { onMessageInline(msg); });
+            conn->setCloseHandler([this, lost = conn.get()](std::error_code ec)
+                                  { connectionLost(lost, ec); });
+
+            std::shared_ptr<Connection<T>> old;
+            {
+                std::scoped_lock<std::mutex> lock(muxConnection);
+                old = std::move(_connection);
+                _connection = std::move(conn);
+            }
+            retire(std::move(old));
+
+            auto resolver = std::make_shared<asio::ip::tcp::resolver>(_context);
+            resolver->async_resolve(_host, _port,
+                                    [this, resolver](std::error_code ec_, asio::ip::tcp::resolver::results_type endpoints_)
+                                    {
+                                        if (ec_)
+                                        {
+                                            connectFailed(ec_);
+                                            return;
+                                        }
+
+                                        _connection->connectToServer(endpoints_, 0, [this](std::error_code ec)
+                                                                     {
+                                                                         if (ec)
+                                                                             connectFailed(ec);
+                                                                         else
+                                                                             connected(); });
+                                    });
+        }
+
+        void connected()
+        {
+            {
+                // Flush the backlog ahead of anything sent from now on
+                std::scoped_lock<std::mutex> lock(muxConnection);
+                for (auto &msg : _backlog)
+                    _connection->send(std::move(msg));
+                _backlog.clear();
+                _connected.store(true, std::memory_order_release);
+            }
+            _attempt = 0;
+            _connectWaiter.notify();
+            onConnect(std::error_code());
+        }
+
+        void connectFailed(std::error_code ec_)
+        {
+            onConnect(ec_);
+            scheduleReconnect();
+        }
+
+        // A blip must not cost messages: what the lost connection never
+        // wrote goes back to the front of the backlog, to be sent again on
+        // the next connection or reported through onSendDropped(). The batch
+        // that was being written may reach the server twice.
+        void connectionLost(Connection<T> *lost_, std::error_code ec_)
+        {
+            std::shared_ptr<Connection<T>> lost;
+            {
+                // From here on send() fills the backlog
+                std::scoped_lock<std::mutex> lock(muxConnection);
+                _connected.store(false, std::memory_order_release);
+                if (_connection.get() == lost_)
+                    lost = _connection;
+            }
+
+            // Posted behind any send() that got in before the flip above
+            asio::post(_context, [this, lost = std::move(lost), ec_]()
+                       {
+                           if (lost)
+                           {
+                               std::deque<Message<T>> unsent;
+                               lost->takeUnsent([&unsent](Message<T> &&msg)
+                                                { unsent.push_back(std::move(msg)); });
+
+                               std::scoped_lock<std::mutex> lock(muxConnection);
+                               _backlog.insert(_backlog.begin(), std::make_move_iterator(unsent.begin()),
+                                               std::make_move_iterator(unsent.end()));
+                           }
+                           onDisconnect(ec_);
+                           scheduleReconnect(); });
+        }
+
+        void scheduleReconnect()
+        {
+            if (!_reconnect || _stopping)
+            {
+                std::deque<Message<T>> dropped;
+                {
+                    // Nothing will flush the backlog any more, and later
+                    // sends fail straight away instead of piling up
+                    std::scoped_lock<std::mutex> lock(muxConnection);
+                    _stopping = true;
+                    dropped.swap(_backlog);
+                }
+                for (auto &msg : dropped)
+                    onSendDropped(msg);
+                return;
+            }
+
+            // Exponential backoff with jitter, so a fleet of clients does
+            // not come back in lockstep
+            const auto ceiling = std::min(_maxDelay, _initialDelay * (int64_t(1) << std::min<size_t>(_attempt, 20)));
+            std::uniform_int_distribution<int64_t> jitter(ceiling.count() / 2, ceiling.count());
+            _attempt++;
+
+            _retryTimer.expires_after(std::chrono::milliseconds(jitter(_rng)));
+            _retryTimer.async_wait([this](std::error_code ec_)
+                                   {
+                                       if (!ec_ && !_stopping)
+                                           startConnect(); });
+        }
+
+        std::shared_ptr<Connection<T>> currentConnection()
+        {
+            std::scoped_lock<std::mutex> lock(muxConnection);
+            return _connection;
+        }
+
+        // Hold a replaced connection one more turn so its aborted handlers still find it
+        void retire(std::shared_ptr<Connection<T>> conn_)
+        {
+            if (!conn_)
+                return;
+            conn_->disconnect();
+            asio::post(_context, [this, conn = std::move(conn_)]() mutable
+                       { asio::post(_context, [conn = std::move(conn)]() {}); });
+        }
+
     protected:
         // asio context handles the data transfer...
         asio::io_context _context;
         // ...but needs a thread of its own to execute its work commands
         std::thread thrContext;
+        // Keeps the thread running after a final connect failure, so work
+        // posted later (sends, RPC calls) still runs and fails properly.
+        // disconnect() stops the context.
+        asio::executor_work_guard<asio::io_context::executor_type> _work{asio::make_work_guard(_context)};
         // The client has a single instance of a "connection" object, which handles data transfer
-        std::unique_ptr<Connection<T>> _connection;
+        std::shared_ptr<Connection<T>> _connection;
+        bool _inlineDelivery = false;
+        bool _asyncReceive = false;
 
     private:
-        XQueue<OwnedMessage<T>> _rxQueue;
+        RxQueue _rxQueue;
+
+        std::string _host;
+        std::string _port;
+        // Guards _connection swaps and the backlog against send()
+        std::mutex muxConnection;
+        std::atomic<bool> _connected{false};
+        std::atomic<bool> _stopping{false};
+        Waiter _connectWaiter;
+        std::deque<Message<T>> _backlog;
+        size_t _maxBacklog = 1024;
+
+        // Reconnect state, only touched on the io thread
+        bool _reconnect = false;
+        std::chrono::milliseconds _initialDelay{100};
+        std::chrono::milliseconds _maxDelay{10000};
+        size_t _attempt = 0;
+        asio::steady_timer _retryTimer{_context};
+        std::minstd_rand _rng{std::random_device{}()};
     };
 } // qlexnet
\ No newline at end of file
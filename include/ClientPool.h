@@ -0,0 +1,190 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <memory_resource>
+#include <thread>
+
+#include "Message.h"
+#include "XQueue.h"
+#include "MPSCQueue.h"
+#include "ConnectionRegistry.h"
+#include "Connection.h"
+#include "ConnectionFactory.h"
+
+namespace qlexnet
+{
+    // Many client connections served by a fixed set of io threads.
+    // Unlike ClientInterface, which owns a context and a thread per
+    // connection, every connection here lives on the pool's io_context, so
+    // opening or closing one never creates a thread. Received messages go to
+    // the pool's rx queue tagged with their connection's handle, or to a
+    // queue given per connection.
+    template <typename T, typename RxQueue = XQueue<OwnedMessage<T>>>
+    class ClientPool : public ConnectionFactory<T>
+    {
+    public:
+        // resource_, if given, also backs the rx queue (see ConnectionFactory).
+        explicit ClientPool(size_t threadCount_ = 1, std::pmr::memory_resource *resource_ = nullptr)
+            : ConnectionFactory<T>(resource_), _work(asio::make_work_guard(_context)), _rxQueue(makeQueue<RxQueue>(resource_))
+        {
+            threadCount_ = std::max<size_t>(threadCount_, 1);
+            _strands = threadCount_ > 1;
+            for (size_t i = 0; i < threadCount_; i++)
+                _threads.emplace_back([this]()
+                                      { _context.run(); });
+        }
+
+        ClientPool(const ClientPool &) = delete;
+        virtual ~ClientPool() { stop(); }
+
+    public:
+        // Open a connection delivering to incoming()
+        ConnectionHandle connect(const std::string &host_, const uint16_t port_)
+        {
+            return connect(host_, port_, MessageSink<T>(_rxQueue));
+        }
+
+        // Open a connection delivering to its own queue, which must outlive it
+        ConnectionHandle connect(const std::string &host_, const uint16_t port_, MessageSink<T> rxQueue_)
+        {
+            try
+            {
+                asio::ip::tcp::resolver resolver(_context);
+                return connect(resolver.resolve(host_, std::to_string(port_)), rxQueue_);
+            }
+            catch (std::exception &e)
+            {
+                std::cerr << "ClientPool Exception: " << e.what() << "\n";
+                return {};
+            }
+        }
+
+        ConnectionHandle connect(const asio::ip::tcp::resolver::results_type &endpoints_, MessageSink<T> rxQueue_)
+        {
+            // A strand per connection keeps its handlers serialized when
+            // several threads run the context
+            asio::any_io_executor executor = _strands
+                                                 ? asio::any_io_executor(asio::make_strand(_context))
+                                                 : asio::any_io_executor(_context.get_executor());
+
+            auto conn = this->newConnection(Connection<T>::owner::client, _context, asio::ip::tcp::socket(executor), rxQueue_);
+
+            // Fully set up before sendAll() and other callers can reach it
+            const uint32_t id = nIDCounter++;
+            const ConnectionHandle handle = _connections.reserve();
+            conn->setHandle(handle, true);
+            if (_inlineDelivery)
+                conn->setInlineHandler([this](Connection<T> &client, const MessageView<T> &msg)
+                                       { onMessageInline(client, msg); });
+            _connections.publish(handle, id, conn);
+
+            conn->connectToServer(endpoints_, id);
+            return handle;
+        }
+
+        // Close one connection; its handle goes stale straight away
+        void disconnect(ConnectionHandle client_)
+        {
+            std::shared_ptr<Connection<T>> conn = _connections.resolve(client_);
+            if (!conn)
+                return;
+
+            _connections.remove(conn->GetID());
+            release(std::move(conn));
+        }
+
+        bool isConnected(ConnectionHandle client_)
+        {
+            bool connected = false;
+            _connections.with(client_, [&](Connection<T> &conn)
+                              { connected = conn.isConnected(); });
+            return connected;
+        }
+
+        std::shared_ptr<Connection<T>> resolve(ConnectionHandle client_) { return _connections.resolve(client_); }
+
+        size_t count() { return _connections.count(); }
+
+        void stop()
+        {
+            _work.reset();
+            _context.stop();
+            for (auto &thread : _threads)
+            {
+                if (thread.joinable())
+                    thread.join();
+            }
+            _threads.clear();
+
+            // Nothing runs anymore, the connections can go with the context
+            _connections.clear();
+        }
+
+    public:
+        bool send(ConnectionHandle client_, Message<T> &&msg_)
+        {
+            bool connected = false;
+            _connections.with(client_, [&](Connection<T> &conn)
+                              {
+                                  connected = conn.isConnected();
+                                  if (connected)
+                                      conn.send(std::move(msg_)); });
+            return connected;
+        }
+
+        bool send(ConnectionHandle client_, const Message<T> &msg_)
+        {
+            return send(client_, Message<T>(msg_));
+        }
+
+        // Queue one shared encoding on every connected client
+        void sendAll(const Message<T> &msg_)
+        {
+            SharedFrame<T> frame(msg_);
+            _connections.forEach([&](const std::shared_ptr<Connection<T>> &conn)
+                                 {
+                                     if (conn->isConnected())
+                                         conn->send(frame); });
+        }
+
+        // Messages of every connection opened without a queue of its own.
+        // OwnedMessage::handle tells which one it came from.
+        RxQueue &incoming()
+        {
+            return _rxQueue;
+        }
+
+        // When enabled, received frames skip the queues and are passed to
+        // onMessageInline() on the io threads. Set it before connect().
+        void setInlineDelivery(bool enable_) { _inlineDelivery = enable_; }
+
+    protected:
+        virtual void onMessageInline(Connection<T> &client_, const MessageView<T> &msg_) {}
+
+        // Close on the connection's own executor, then hold the last
+        // reference one more turn so its aborted handlers still find it alive.
+        void release(std::shared_ptr<Connection<T>> conn_)
+        {
+            conn_->disconnect();
+            asio::any_io_executor executor = conn_->executor();
+            asio::post(executor, [executor, conn = std::move(conn_)]() mutable
+                       { asio::post(executor, [conn = std::move(conn)]() {}); });
+        }
+
+    protected:
+        asio::io_context _context;
+        asio::executor_work_guard<asio::io_context::executor_type> _work;
+        std::vector<std::thread> _threads;
+        bool _strands = false;
+        bool _inlineDelivery = false;
+        std::atomic<uint32_t> nIDCounter = 1;
+
+    private:
+        RxQueue _rxQueue;
+        // Declared last so sockets go before the context
+        ConnectionRegistry<T> _connections;
+    };
+} // qlexnet
@@ -2,14 +2,44 @@
 
 #include <asio.hpp>
 #include <asio/ts/buffer.hpp>
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory_resource>
 #include <ostream>
+#include <vector>
 
 #include "Message.h"
 #include "XQueue.h"
+#include "BufferPool.h"
+#include "HandlerAllocator.h"
 
 
 namespace qlexnet
 {
+    // Non-owning, type-erased reference to the queue a connection delivers
+    // its messages to. Any queue with push_back(OwnedMessage<T>&&) fits
+    // (XQueue, MPSCQueue, ...), at the cost of one indirect call per message.
+    template <typename T>
+    class MessageSink
+    {
+    public:
+        template <typename Queue, typename = std::enable_if_t<!std::is_same_v<Queue, MessageSink<T>>>>
+        MessageSink(Queue &queue_)
+            : _queue(&queue_),
+              _push([](void *queue, OwnedMessage<T> &&msg)
+                    { static_cast<Queue *>(queue)->push_back(std::move(msg)); })
+        {
+        }
+
+        void push_back(OwnedMessage<T> &&msg_) const { _push(_queue, std::move(msg_)); }
+
+    private:
+        void *_queue;
+        void (*_push)(void *, OwnedMessage<T> &&);
+    };
+
     template <typename T>
     class Connection : public std::enable_shared_from_this<Connection<T>>
     {
@@ -21,15 +51,45 @@ namespace qlexnet
         };
 
     public:
-        Connection(owner parent_, asio::io_context &asioContext_, asio::ip::tcp::socket socket_, XQueue<OwnedMessage<T>> &rxQueue_)
-            : _asioContext(asioContext_), _socket(std::move(socket_)), _rxQueue(rxQueue_)
+        // resource_, when given, backs the tx/rx containers and the state
+        // of the completion handlers. It is used from the io thread and from
+        // every thread calling send(), so it must be thread-safe
+        // (e.g. std::pmr::synchronized_pool_resource).
+        Connection(owner parent_, asio::io_context &asioContext_, asio::ip::tcp::socket socket_, MessageSink<T> rxQueue_,
+                   BodyPool<T> *bodyPool_ = nullptr, std::pmr::memory_resource *resource_ = nullptr)
+            : _socket(std::move(socket_)), _asioContext(asioContext_), _handlerAlloc(resource_),
+              _queueNodes(orDefault(resource_)), _txQueue(&_queueNodes), _txBuffers(orDefault(resource_)),
+              _rxQueue(rxQueue_), _bodyPool(bodyPool_), _inbox(&_queueNodes), _rxBuffer(orDefault(resource_))
         {
             _ownerType = parent_;
         }
 
-        virtual ~Connection() {}
+        virtual ~Connection()
+        {
+            if (_handlerArena)
+                _handlerArena->release(_handlerAlloc.memory());
+        }
 
         uint32_t GetID() const { return _id; }
+        ConnectionHandle GetHandle() const { return _handle; }
+
+        // Set by the server before the connection starts reading. With
+        // handleOnly_, received messages carry just the handle and the hot
+        // path does no shared_ptr refcounting.
+        void setHandle(ConnectionHandle handle_, bool handleOnly_)
+        {
+            _handle = handle_;
+            _handleOnly = handleOnly_;
+        }
+
+        // Lease a HandlerMemory from arena_ so the hot-path handlers reuse
+        // the same blocks, whichever thread sends. It goes back to the arena
+        // with the connection. Must be set before the connection starts.
+        void setHandlerArena(HandlerArena *arena_)
+        {
+            _handlerArena = arena_;
+            _handlerAlloc = HandlerAllocator<void>(_handlerAlloc.resource(), arena_->acquire());
+        }
 
     public:
         void connectToClient(uint32_t id_ = 0)
@@ -39,22 +99,29 @@ namespace qlexnet
                 if (_socket.is_open())
                 {
                     _id = id_;
-                    readHeader();
+                    readFrames();
                 }
             }
         }
 
-        void connectToServer(const asio::ip::tcp::resolver::results_type &endpoints_)
+        using StateHandler = std::function<void(std::error_code)>;
+
+        // onConnect_, if set, runs on the io thread once the attempt is over
+        void connectToServer(const asio::ip::tcp::resolver::results_type &endpoints_, uint32_t id_ = 0,
+                             StateHandler onConnect_ = {})
         {
             if (_ownerType == owner::client)
             {
+                _id = id_;
                 asio::async_connect(_socket, endpoints_,
-                                    [this](std::error_code ec_, asio::ip::tcp::endpoint endpoint_)
+                                    [this, onConnect = std::move(onConnect_)](std::error_code ec_, asio::ip::tcp::endpoint endpoint_)
                                     {
                                         if (!ec_)
                                         {
-                                            readHeader();
+                                            readFrames();
                                         }
+                                        if (onConnect)
+                                            onConnect(ec_);
                                     });
             }
         }
@@ -63,141 +130,574 @@ namespace qlexnet
         {
             if (isConnected())
             {
-                asio::post(_asioContext, [this]()
+                asio::post(_socket.get_executor(), [this]()
                            { _socket.close(); });
             }
         }
 
         bool isConnected() const { return _socket.is_open(); }
 
+        // Once a read or write error has closed the connection, hands every
+        // message it has not confirmed written to f_, oldest first, so the
+        // owner can send them again. The batch that was being written may
+        // have partly reached the peer already. async_send() callers get
+        // operation_aborted instead. Only call on the connection's executor.
+        template <typename F>
+        void takeUnsent(F &&f_)
+        {
+            for (auto &entry : _txQueue)
+            {
+                if (entry.done)
+                {
+                    complete(std::move(entry.done), std::error_code(asio::error::operation_aborted));
+                }
+                else if (!entry.frame.empty())
+                {
+                    Message<T> msg;
+                    msg.header = entry.frame.header();
+                    msg.body.resize(entry.frame.size() - sizeof(MessageHeader<T>));
+                    if (!msg.body.empty())
+                        std::memcpy(msg.body.data(), entry.frame.data() + sizeof(MessageHeader<T>), msg.body.size());
+                    f_(std::move(msg));
+                }
+                else
+                {
+                    f_(std::move(entry.msg));
+                }
+            }
+            _txQueue.clear();
+            _txInFlight = 0;
+        }
+
+        // Destroy the async_receive()/async_send() handlers still waiting
+        // without running them. A coroutine suspended in one may hold this
+        // connection, so the two would keep each other alive. Only call it
+        // once the io_context has stopped and nothing can complete them.
+        void dropPendingHandlers()
+        {
+            _pendingReceive = nullptr;
+            for (auto &entry : _txQueue)
+                entry.done = nullptr;
+        }
+
+        // Called on the io thread when a read or write error closes the
+        // connection; not when disconnect() is used.
+        void setCloseHandler(StateHandler handler_)
+        {
+            _closeHandler = std::move(handler_);
+        }
+
+        using InlineHandler = std::function<void(Connection<T> &, const MessageView<T> &)>;
+
+        // Run handler_ on the io thread (the connection's strand) for every
+        // received frame instead of queueing it. The view is only valid
+        // during the call. Must be set before the connection starts reading.
+        void setInlineHandler(InlineHandler handler_)
+        {
+            _inlineHandler = std::move(handler_);
+        }
+
+        // Largest size the receive buffer grows to. It starts small and
+        // doubles while reads fill it; frames larger than this are completed
+        // with a direct read into the message body.
+        // Must be called before the connection starts reading.
+        void setReadBufferSize(size_t bytes_)
+        {
+            _rxLimit = std::max(bytes_, sizeof(MessageHeader<T>));
+        }
+
+        // Bound how much of the tx queue a single gathered write may carry.
+        // The default buffer count matches asio's per-writev iovec cap.
+        void setWriteBatchLimits(size_t maxBuffers_, size_t maxBytes_)
+        {
+            _maxWriteBuffers = std::max<size_t>(maxBuffers_, 2);
+            _maxWriteBytes = maxBytes_;
+        }
+
         void startListening() {}
 
     public:
         void send(const Message<T> &msg_)
         {
-            asio::post(_asioContext,
-                       [this, msg_]()
-                       {
-                           bool bWritingMessage = !_txQueue.empty();
-                           _txQueue.push_back(msg_);
-                           if (!bWritingMessage)
-                           {
-                               writeHeader();
-                           }
-                       });
+            send(Message<T>(msg_));
+        }
+
+        // The message is moved into the posted handler and then into the tx
+        // queue, its body is never copied on the way to the socket.
+        void send(Message<T> &&msg_)
+        {
+            asio::post(_socket.get_executor(),
+                       asio::bind_allocator(_handlerAlloc,
+                                            [this, msg = std::move(msg_)]() mutable
+                                            {
+                                                bool bWritingMessage = !_txQueue.empty();
+                                                _txQueue.push_back({std::move(msg), SharedFrame<T>{}, SendHandler()});
+                                                if (!bWritingMessage)
+                                                {
+                                                    writeBatch();
+                                                }
+                                            }));
+        }
+
+        // Build the message in place from its id and body
+        void emplaceSend(T id_, BodyBuffer<T> &&body_)
+        {
+            Message<T> msg;
+            msg.header.id = id_;
+            msg.header.size = static_cast<uint32_t>(body_.size());
+            adoptBody<T>(msg.body, std::move(body_));
+            send(std::move(msg));
+        }
+
+        // Queue a pre-encoded frame; only its refcount is touched, the
+        // payload is shared with every other connection sending it.
+        void send(const SharedFrame<T> &frame_)
+        {
+            asio::post(_socket.get_executor(),
+                       asio::bind_allocator(_handlerAlloc,
+                                            [this, frame_]()
+                                            {
+                                                bool bWritingMessage = !_txQueue.empty();
+                                                _txQueue.push_back({Message<T>{}, frame_, SendHandler()});
+                                                if (!bWritingMessage)
+                                                {
+                                                    writeBatch();
+                                                }
+                                            }));
+        }
+
+        // Completes once the message has been written to the socket.
+        // Works with any asio completion token; with the default one,
+        // `co_await conn.async_send(msg)` inside an asio::awaitable.
+        template <typename CompletionToken = asio::deferred_t>
+        auto async_send(Message<T> msg_, CompletionToken &&token_ = {})
+        {
+            return asio::async_initiate<CompletionToken, void(std::error_code)>(
+                [this](auto handler, Message<T> msg)
+                {
+                    asio::post(_socket.get_executor(),
+                               [this, msg = std::move(msg), done = SendHandler(std::move(handler))]() mutable
+                               {
+                                   if (!isConnected())
+                                   {
+                                       complete(std::move(done), std::error_code(asio::error::not_connected));
+                                       return;
+                                   }
+
+                                   bool bWritingMessage = !_txQueue.empty();
+                                   _txQueue.push_back({std::move(msg), SharedFrame<T>{}, std::move(done)});
+                                   if (!bWritingMessage)
+                                   {
+                                       writeBatch();
+                                   }
+                               });
+                },
+                token_, std::move(msg_));
+        }
+
+        // Deliver received messages to async_receive() rather than the rx
+        // queue. Must be set before the connection starts reading.
+        void enableAsyncReceive()
+        {
+            _asyncReceive = true;
         }
 
+        // Completes with the next received message, or with the error that
+        // closed the connection. Only one receive may be outstanding: a
+        // second one completes with asio::error::in_progress, the first keeps waiting.
+        template <typename CompletionToken = asio::deferred_t>
+        auto async_receive(CompletionToken &&token_ = {})
+        {
+            return asio::async_initiate<CompletionToken, void(std::error_code, Message<T>)>(
+                [this](auto handler)
+                {
+                    asio::post(_socket.get_executor(),
+                               [this, h = ReceiveHandler(std::move(handler))]() mutable
+                               {
+                                   if (!_inbox.empty())
+                                   {
+                                       Message<T> msg = std::move(_inbox.front());
+                                       _inbox.pop_front();
+                                       complete(std::move(h), std::error_code(), std::move(msg));
+                                   }
+                                   else if (_rxError || !isConnected())
+                                   {
+                                       std::error_code ec = _rxError ? _rxError : std::error_code(asio::error::not_connected);
+                                       complete(std::move(h), ec, Message<T>());
+                                   }
+                                   else if (_pendingReceive)
+                                   {
+                                       complete(std::move(h), std::error_code(asio::error::in_progress), Message<T>());
+                                   }
+                                   else
+                                   {
+                                       _pendingReceive = std::move(h);
+                                   }
+                               });
+                },
+                token_);
+        }
+
+        asio::any_io_executor executor() { return _socket.get_executor(); }
+
     private:
-        void writeHeader()
-        {
-            asio::async_write(_socket, asio::buffer(&_txQueue.front().header, sizeof(MessageHeader<T>)),
-                              [this](std::error_code ec_, std::size_t length_)
-                              {
-                                  if (!ec_)
-                                  {
-                                      if (_txQueue.front().body.size() > 0)
-                                      {
-                                          writeBody();
-                                      }
-                                      else
-                                      {
-                                          _txQueue.pop_front();
-
-                                          if (!_txQueue.empty())
-                                          {
-                                              writeHeader();
-                                          }
-                                      }
-                                  }
-                                  else
-                                  {
-                                      std::cout << "[" << _id << "] Write Header Fail.\n";
-                                      _socket.close();
-                                  }
-                              });
-        }
-
-        void writeBody()
-        {
-            asio::async_write(_socket, asio::buffer(_txQueue.front().body.data(), _txQueue.front().body.size()),
-                              [this](std::error_code ec_, std::size_t length_)
-                              {
-                                  if (!ec_)
-                                  {
-                                      _txQueue.pop_front();
-
-                                      if (!_txQueue.empty())
-                                      {
-                                          writeHeader();
-                                      }
-                                  }
-                                  else
-                                  {
-                                      std::cout << "[" << _id << "] Write Body Fail.\n";
-                                      _socket.close();
-                                  }
-                              });
-        }
-
-        void readHeader()
-        {
-            asio::async_read(_socket, asio::buffer(&_msgRxTmp.header, sizeof(MessageHeader<T>)),
-                             [this](std::error_code ec_, std::size_t length_)
-                             {
-                                 if (!ec_)
-                                 {
-                                     if (_msgRxTmp.header.size > 0)
-                                     {
-                                         _msgRxTmp.body.resize(_msgRxTmp.header.size);
-                                         readBody();
-                                     }
-                                     else
-                                     {
-                                         addToIncomingMessageQueue();
-                                     }
-                                 }
-                                 else
-                                 {
-                                     std::cout << "[" << _id << "] Read Header Fail. " << ec_ << " \n";
-                                     _socket.close();
-                                 }
-                             });
-        }
-
-        void readBody()
-        {
-            asio::async_read(_socket, asio::buffer(_msgRxTmp.body.data(), _msgRxTmp.body.size()),
-                             [this](std::error_code ec_, std::size_t length_)
-                             {
-                                 if (!ec_)
-                                 {
-                                     addToIncomingMessageQueue();
-                                 }
-                                 else
-                                 {
-                                     std::cout << "[" << _id << "] Read Body Fail.\n";
-                                     _socket.close();
-                                 }
-                             });
+        static std::pmr::memory_resource *orDefault(std::pmr::memory_resource *resource_)
+        {
+            return resource_ ? resource_ : std::pmr::get_default_resource();
+        }
+
+        using SendHandler = asio::any_completion_handler<void(std::error_code)>;
+        using ReceiveHandler = asio::any_completion_handler<void(std::error_code, Message<T>)>;
+
+        // Run a stored completion handler, never inline. post() forwards it
+        // to the handler's associated executor when it has one.
+        template <typename Handler, typename... Args>
+        void complete(Handler &&handler_, Args &&...args_)
+        {
+            asio::post(_socket.get_executor(), asio::append(std::move(handler_), std::forward<Args>(args_)...));
+        }
+
+        void failReceive(std::error_code ec_)
+        {
+            _rxError = ec_;
+            if (_pendingReceive)
+                complete(std::move(_pendingReceive), ec_, Message<T>());
+        }
+
+        // Close after an I/O error, telling the close handler only once
+        void fail(std::error_code ec_)
+        {
+            failReceive(ec_);
+            if (!_socket.is_open())
+                return;
+
+            _socket.close();
+            if (_closeHandler)
+                _closeHandler(ec_);
+        }
+
+        void writeBatch()
+        {
+            // Gather every queued message, up to the batch limits, into one
+            // scatter-gather sequence. Header and body of each message are
+            // adjacent buffers, so a burst goes out in as few writev as possible.
+            _txBuffers.clear();
+            _txInFlight = 0;
+
+            size_t batchBytes = 0;
+            for (const TxEntry &entry : _txQueue)
+            {
+                const Message<T> &msg = entry.msg;
+                const size_t msgBuffers = (entry.frame.empty() && !msg.body.empty()) ? 2 : 1;
+                const size_t msgBytes = entry.frame.empty() ? sizeof(MessageHeader<T>) + msg.body.size()
+                                                            : entry.frame.size();
+
+                // Always send at least one message, even if it exceeds the limits
+                if (_txInFlight > 0 &&
+                    (_txBuffers.size() + msgBuffers > _maxWriteBuffers || batchBytes + msgBytes > _maxWriteBytes))
+                    break;
+
+                if (!entry.frame.empty())
+                {
+                    _txBuffers.push_back(asio::buffer(entry.frame.data(), entry.frame.size()));
+                }
+                else
+                {
+                    _txBuffers.push_back(asio::buffer(&msg.header, sizeof(MessageHeader<T>)));
+                    if (!msg.body.empty())
+                        _txBuffers.push_back(asio::buffer(msg.body.data(), msg.body.size()));
+                }
+
+                batchBytes += msgBytes;
+                _txInFlight++;
+            }
+
+            asio::async_write(_socket, TxBufferView{_txBuffers.data(), _txBuffers.data() + _txBuffers.size()},
+                              asio::bind_allocator(_handlerAlloc,
+                                                   [this](std::error_code ec_, std::size_t length_)
+                                                   {
+                                                       if (!ec_)
+                                                       {
+                                                           for (size_t i = 0; i < _txInFlight; i++)
+                                                           {
+                                                               if (_txQueue[i].done)
+                                                                   complete(std::move(_txQueue[i].done), ec_);
+                                                               // Written bodies feed the next reads and acquireMessage()
+                                                               if (_bodyPool)
+                                                                   _bodyPool->release(std::move(_txQueue[i].msg.body));
+                                                           }
+                                                           _txQueue.erase(_txQueue.begin(), _txQueue.begin() + _txInFlight);
+                                                           _txInFlight = 0;
+
+                                                           if (!_txQueue.empty())
+                                                           {
+                                                               writeBatch();
+                                                           }
+                                                       }
+                                                       else
+                                                       {
+                                                           std::cout << "[" << _id << "] Write Batch Fail.\n";
+                                                           for (auto &entry : _txQueue)
+                                                           {
+                                                               if (entry.done)
+                                                                   complete(std::move(entry.done), ec_);
+                                                           }
+                                                           fail(ec_);
+                                                       }
+                                                   }));
+        }
+
+        void readFrames()
+        {
+            // Keep the unparsed tail at the front so the free space is contiguous
+            if (_rxBegin > 0)
+            {
+                std::memmove(_rxBuffer.data(), _rxBuffer.data() + _rxBegin, _rxEnd - _rxBegin);
+                _rxEnd -= _rxBegin;
+                _rxBegin = 0;
+            }
+
+            // Only a partial frame can fill the buffer, make room for the rest
+            if (_rxEnd == _rxBuffer.size() && _rxBuffer.size() < _rxLimit)
+                _rxBuffer.grow(std::min(_rxLimit, std::max(2 * _rxBuffer.size(), initialReadBuffer)), _rxEnd);
+
+            _socket.async_read_some(asio::buffer(_rxBuffer.data() + _rxEnd, _rxBuffer.size() - _rxEnd),
+                                    asio::bind_allocator(_handlerAlloc,
+                                                         [this](std::error_code ec_, std::size_t length_)
+                                                         {
+                                                             if (!ec_)
+                                                             {
+                                                                 _rxEnd += length_;
+                                                                 parseFrames();
+                                                             }
+                                                             else
+                                                             {
+                                                                 std::cout << "[" << _id << "] Read Fail. " << ec_ << " \n";
+                                                                 fail(ec_);
+                                                             }
+                                                         }));
+        }
+
+        // Extract every complete frame sitting in the receive buffer, then go
+        // back to the socket for more.
+        void parseFrames()
+        {
+            while (_rxEnd - _rxBegin >= sizeof(MessageHeader<T>))
+            {
+                const uint8_t *frame = _rxBuffer.data() + _rxBegin;
+                const size_t available = _rxEnd - _rxBegin - sizeof(MessageHeader<T>);
+
+                std::memcpy(&_msgRxTmp.header, frame, sizeof(MessageHeader<T>));
+                const size_t bodySize = _msgRxTmp.header.size;
+
+                if (available >= bodySize)
+                {
+                    if (_inlineHandler)
+                    {
+                        // Handed straight out of the receive buffer, no copy at all
+                        _rxBegin += sizeof(MessageHeader<T>) + bodySize;
+                        _inlineHandler(*this, MessageView<T>{_msgRxTmp.header, frame + sizeof(MessageHeader<T>), bodySize});
+                        continue;
+                    }
+
+                    prepareBody(bodySize);
+                    if (bodySize > 0)
+                        std::memcpy(_msgRxTmp.body.data(), frame + sizeof(MessageHeader<T>), bodySize);
+
+                    _rxBegin += sizeof(MessageHeader<T>) + bodySize;
+                    addToIncomingMessageQueue();
+                }
+                else if (sizeof(MessageHeader<T>) + bodySize > _rxLimit)
+                {
+                    // Frame can never fit in the buffer: keep what we have and
+                    // read the rest of the body straight into the message.
+                    prepareBody(bodySize);
+                    std::memcpy(_msgRxTmp.body.data(), frame + sizeof(MessageHeader<T>), available);
+
+                    _rxBegin = _rxEnd = 0;
+                    readBody(available);
+                    return;
+                }
+                else
+                {
+                    break;
+                }
+            }
+
+            readFrames();
+        }
+
+        void readBody(size_t offset_)
+        {
+            asio::async_read(_socket, asio::buffer(_msgRxTmp.body.data() + offset_, _msgRxTmp.body.size() - offset_),
+                             asio::bind_allocator(_handlerAlloc,
+                                                  [this](std::error_code ec_, std::size_t length_)
+                                                  {
+                                                      if (!ec_)
+                                                      {
+                                                          addToIncomingMessageQueue();
+                                                          readFrames();
+                                                      }
+                                                      else
+                                                      {
+                                                          std::cout << "[" << _id << "] Read Body Fail.\n";
+                                                          fail(ec_);
+                                                      }
+                                                  }));
+        }
+
+        void prepareBody(size_t size_)
+        {
+            // The previous body was handed off to the rx queue, draw a
+            // recycled buffer rather than allocating a fresh one. Bodies
+            // that fit a SmallBuffer's inline storage never get here.
+            if (size_ > _msgRxTmp.body.capacity() && _bodyPool)
+                adoptBody<T>(_msgRxTmp.body, _bodyPool->acquire());
+
+            _msgRxTmp.body.resize(size_);
         }
 
         void addToIncomingMessageQueue()
         {
-            if (_ownerType == owner::server)
-                _rxQueue.push_back({this->shared_from_this(), _msgRxTmp});
+            if (_inlineHandler)
+            {
+                // The body stays with the connection for the next large frame
+                _inlineHandler(*this, MessageView<T>{_msgRxTmp.header, _msgRxTmp.body.data(), _msgRxTmp.body.size()});
+                return;
+            }
+
+            if (_asyncReceive)
+            {
+                if (_pendingReceive)
+                    complete(std::move(_pendingReceive), std::error_code(), std::move(_msgRxTmp));
+                else
+                    _inbox.push_back(std::move(_msgRxTmp));
+
+                _msgRxTmp.body.clear();
+                return;
+            }
+
+            // Hand the finished message over without copying its body
+            if (_ownerType == owner::server && _handleOnly)
+                _rxQueue.push_back({nullptr, std::move(_msgRxTmp), _handle});
+            else if (_ownerType == owner::server)
+                _rxQueue.push_back({this->shared_from_this(), std::move(_msgRxTmp), _handle});
             else
-                _rxQueue.push_back({nullptr, _msgRxTmp});
+                _rxQueue.push_back({nullptr, std::move(_msgRxTmp), _handle});
 
-            readHeader();
+            _msgRxTmp.body.clear();
         }
 
     protected:
         asio::ip::tcp::socket _socket;
         asio::io_context &_asioContext;
-        XQueue<Message<T>> _txQueue;
-        XQueue<OwnedMessage<T>> &_rxQueue;
+        // Outgoing item: either an owned message or a shared pre-encoded frame
+        struct TxEntry
+        {
+            Message<T> msg;
+            SharedFrame<T> frame;
+            // Set by async_send(), completed once the entry is written
+            SendHandler done;
+        };
+
+        // Bound to the hot-path handlers: sends, reads and writes
+        HandlerAllocator<void> _handlerAlloc;
+        HandlerArena *_handlerArena = nullptr;
+        // Keeps the blocks _txQueue and _inbox free as they drain, so a
+        // connection at steady load allocates none. Both are only used on
+        // the socket's executor.
+        std::pmr::unsynchronized_pool_resource _queueNodes;
+        // Only touched from the asio thread, no locking needed
+        std::pmr::deque<TxEntry> _txQueue;
+        std::pmr::vector<asio::const_buffer> _txBuffers;
+        // What async_write gets instead of _txBuffers itself: it keeps a copy
+        // of the sequence for the whole write, and copying the vector would
+        // allocate on every batch. _txBuffers is left alone until completion.
+        struct TxBufferView
+        {
+            const asio::const_buffer *first;
+            const asio::const_buffer *last;
+            const asio::const_buffer *begin() const { return first; }
+            const asio::const_buffer *end() const { return last; }
+        };
+        size_t _txInFlight = 0;
+        size_t _maxWriteBuffers = 64;
+        size_t _maxWriteBytes = 256 * 1024;
+        MessageSink<T> _rxQueue;
+        BodyPool<T> *_bodyPool = nullptr;
+        InlineHandler _inlineHandler;
+        StateHandler _closeHandler;
+        // async_receive() state, only touched on the connection's strand
+        bool _asyncReceive = false;
+        std::pmr::deque<Message<T>> _inbox;
+        ReceiveHandler _pendingReceive;
+        std::error_code _rxError;
         Message<T> _msgRxTmp;
+        // Receive buffer storage. Never zero-filled, every byte parsed was
+        // written by a read first.
+        class ReadBuffer
+        {
+        public:
+            explicit ReadBuffer(std::pmr::memory_resource *resource_) : _resource(resource_) {}
+            ReadBuffer(const ReadBuffer &) = delete;
+            ~ReadBuffer()
+            {
+                if (_data)
+                    _resource->deallocate(_data, _size);
+            }
+
+            uint8_t *data() { return _data; }
+            size_t size() const { return _size; }
+
+            // Reallocate to size_ bytes, keeping the first used_
+            void grow(size_t size_, size_t used_)
+            {
+                uint8_t *bigger = static_cast<uint8_t *>(_resource->allocate(size_));
+                if (used_ > 0)
+                    std::memcpy(bigger, _data, used_);
+                if (_data)
+                    _resource->deallocate(_data, _size);
+                _data = bigger;
+                _size = size_;
+            }
+
+        private:
+            std::pmr::memory_resource *_resource;
+            uint8_t *_data = nullptr;
+            size_t _size = 0;
+        };
+        // Size of the first allocation, made when the connection starts reading
+        static constexpr size_t initialReadBuffer = 4 * 1024;
+        // Receive buffer, [_rxBegin, _rxEnd) holds bytes not parsed yet
+        ReadBuffer _rxBuffer;
+        size_t _rxLimit = 64 * 1024;
+        size_t _rxBegin = 0;
+        size_t _rxEnd = 0;
         owner _ownerType = owner::server;
         uint32_t _id = 0;
+        ConnectionHandle _handle{};
+        bool _handleOnly = false;
     };
-} // qlexnet
\ No newline at end of file
+
+    // Connection with its control block allocated from resource_, if given
+    template <typename T, typename... Args>
+    std::shared_ptr<Connection<T>> makeConnection(std::pmr::memory_resource *resource_, Args &&...args_)
+    {
+        if (resource_)
+            return std::allocate_shared<Connection<T>>(std::pmr::polymorphic_allocator<Connection<T>>(resource_),
+                                                       std::forward<Args>(args_)..., resource_);
+        return std::make_shared<Connection<T>>(std::forward<Args>(args_)..., resource_);
+    }
+
+    // Build an rx queue on resource_ when its type can take one (XQueue, FairQueue)
+    template <typename Queue>
+    Queue makeQueue(std::pmr::memory_resource *resource_)
+    {
+        if constexpr (std::is_constructible_v<Queue, std::pmr::memory_resource *>)
+        {
+            if (resource_)
+                return Queue(resource_);
+        }
+        return Queue();
+    }
+} // qlexnet
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <memory>
+#include <memory_resource>
+
+#include "Message.h"
+#include "BufferPool.h"
+#include "MessageLease.h"
+#include "HandlerAllocator.h"
+#include "Connection.h"
+
+namespace qlexnet
+{
+    // What the connections of a server, client or client pool draw from:
+    // the memory resource, the pool recycling message bodies and the arena
+    // of handler memory. ServerInterface, ClientInterface and ClientPool
+    // derive from it and make every connection through newConnection().
+    // As a base it is destroyed after the owner's io_context, which the
+    // handler arena must outlive.
+    template <typename T>
+    class ConnectionFactory
+    {
+    public:
+        ConnectionFactory(const ConnectionFactory &) = delete;
+
+        // Message with a recycled body. Send it with take(); the body comes
+        // back to the pool once written, or when the lease is dropped.
+        MessageLease<T> acquireMessage(T id_, size_t reserve_ = 0)
+        {
+            return MessageLease<T>(_bodyPool, id_, reserve_);
+        }
+
+        // Give a consumed message's body back so the connections can reuse it
+        void recycle(Message<T> &msg_)
+        {
+            _bodyPool.release(std::move(msg_.body));
+        }
+
+        // Largest receive buffer of each connection, 64 KiB by default. The
+        // buffers start at 4 KiB and grow while reads fill them; larger
+        // frames are read straight into the message body.
+        // Must be set before start()/connect().
+        void setReadBufferSize(size_t bytes_) { _readBufferSize = bytes_; }
+
+    protected:
+        // resource_, if given, backs message bodies (see
+        // MessageTraits::pmrBody) and connections. It is used from every
+        // io thread and every thread sending, so it must be thread-safe.
+        explicit ConnectionFactory(std::pmr::memory_resource *resource_)
+            : _resource(resource_)
+        {
+            _bodyPool.setResource(resource_);
+        }
+
+        ~ConnectionFactory() = default;
+
+        // Connection using this factory's resource, body pool and handler
+        // memory. Finish setting it up before it is shared with other
+        // threads or starts reading.
+        std::shared_ptr<Connection<T>> newConnection(typename Connection<T>::owner owner_, asio::io_context &context_,
+                                                     asio::ip::tcp::socket socket_, MessageSink<T> rxQueue_)
+        {
+            auto conn = makeConnection<T>(_resource, owner_, context_, std::move(socket_), rxQueue_, &_bodyPool);
+            conn->setHandlerArena(&_handlerArena);
+            conn->setReadBufferSize(_readBufferSize);
+            return conn;
+        }
+
+    protected:
+        std::pmr::memory_resource *_resource = nullptr;
+        BodyPool<T> _bodyPool;
+        HandlerArena _handlerArena;
+        size_t _readBufferSize = 64 * 1024;
+    };
+} // qlexnet
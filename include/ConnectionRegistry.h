@@ -0,0 +1,233 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace qlexnet
+{
+    template <typename T>
+    class Connection;
+
+    // Compact, copyable reference to a registered connection: its registry
+    // slot plus the slot generation at registration time. Copying it does no
+    // refcount traffic, and once the connection is removed the generation no
+    // longer matches, so stale handles resolve to nothing.
+    struct ConnectionHandle
+    {
+        uint32_t slot = UINT32_MAX;
+        uint32_t generation = 0;
+
+        bool valid() const { return slot != UINT32_MAX; }
+        uint64_t value() const { return (uint64_t(generation) << 32) | slot; }
+
+        friend bool operator==(const ConnectionHandle &a, const ConnectionHandle &b) { return a.value() == b.value(); }
+        friend bool operator!=(const ConnectionHandle &a, const ConnectionHandle &b) { return !(a == b); }
+    };
+
+    // Connections of a server shard or client pool, indexed by client ID.
+    // Connections are stored densely for cheap iteration. Each one also
+    // owns a stable slot, whose generation is bumped every time the slot is
+    // freed, and an ID -> slot map gives O(1) lookup. Insert, lookup and
+    // removal are all O(1) and guarded by a mutex, so the accept handlers
+    // may register clients while update() is reading.
+    // A connection that needs its handle before other threads can reach it
+    // takes a slot with reserve(), finishes its setup, then publish()es.
+    // Registry index_ of count_ hands out slot numbers index_, index_ +
+    // count_, ... so handles from sibling registries never collide and
+    // slot % count_ tells which registry a handle belongs to.
+    template <typename T>
+    class ConnectionRegistry
+    {
+    public:
+        using ConnectionList = std::vector<std::shared_ptr<Connection<T>>>;
+
+        explicit ConnectionRegistry(uint32_t index_ = 0, uint32_t count_ = 1)
+            : _index(index_), _count(count_)
+        {
+        }
+
+        ConnectionRegistry(const ConnectionRegistry<T> &) = delete;
+
+    public:
+        ConnectionHandle insert(uint32_t id_, std::shared_ptr<Connection<T>> conn_)
+        {
+            const ConnectionHandle handle = reserve();
+            publish(handle, id_, std::move(conn_));
+            return handle;
+        }
+
+        // Takes a slot without registering anything: the handle does not
+        // resolve until publish()
+        ConnectionHandle reserve()
+        {
+            std::scoped_lock<std::mutex> lock(muxRegistry);
+
+            uint32_t slot;
+            if (!_freeSlots.empty())
+            {
+                slot = _freeSlots.back();
+                _freeSlots.pop_back();
+            }
+            else
+            {
+                slot = static_cast<uint32_t>(_slots.size());
+                _slots.push_back({});
+            }
+            return {slot * _count + _index, _slots[slot].generation};
+        }
+
+        // Registers conn_ under a handle from reserve(), making it visible to
+        // lookups and iteration
+        void publish(ConnectionHandle handle_, uint32_t id_, std::shared_ptr<Connection<T>> conn_)
+        {
+            std::scoped_lock<std::mutex> lock(muxRegistry);
+
+            const uint32_t slot = handle_.slot / _count;
+            _slots[slot].dense = static_cast<uint32_t>(_dense.size());
+            _slots[slot].used = true;
+            _idToSlot[id_] = slot;
+            _dense.push_back({std::move(conn_), slot});
+            _snapshot.reset();
+        }
+
+        bool remove(uint32_t id_)
+        {
+            std::scoped_lock<std::mutex> lock(muxRegistry);
+
+            auto it = _idToSlot.find(id_);
+            if (it == _idToSlot.end())
+                return false;
+
+            const uint32_t slot = it->second;
+            _idToSlot.erase(it);
+
+            // Swap-remove from the dense array and patch the moved entry's slot
+            const uint32_t dense = _slots[slot].dense;
+            if (dense != _dense.size() - 1)
+            {
+                _dense[dense] = std::move(_dense.back());
+                _slots[_dense[dense].slot].dense = dense;
+            }
+            _dense.pop_back();
+
+            _slots[slot].used = false;
+            _slots[slot].generation++;
+            _freeSlots.push_back(slot);
+            _snapshot.reset();
+            return true;
+        }
+
+        std::shared_ptr<Connection<T>> find(uint32_t id_)
+        {
+            std::scoped_lock<std::mutex> lock(muxRegistry);
+
+            auto it = _idToSlot.find(id_);
+            if (it == _idToSlot.end())
+                return nullptr;
+            return _dense[_slots[it->second].dense].conn;
+        }
+
+        // Owning lookup, nullptr for a stale handle
+        std::shared_ptr<Connection<T>> resolve(ConnectionHandle handle_)
+        {
+            std::scoped_lock<std::mutex> lock(muxRegistry);
+            if (!live(handle_))
+                return nullptr;
+            return _dense[_slots[handle_.slot / _count].dense].conn;
+        }
+
+        // Calls f_(conn) with the registry locked and without touching the
+        // refcount. Returns false if the handle is stale.
+        template <typename F>
+        bool with(ConnectionHandle handle_, F &&f_)
+        {
+            std::scoped_lock<std::mutex> lock(muxRegistry);
+            if (!live(handle_))
+                return false;
+            f_(*_dense[_slots[handle_.slot / _count].dense].conn);
+            return true;
+        }
+
+        // Calls f_(conn) for every connection, with the registry locked:
+        // f_ must not call back into the registry.
+        template <typename F>
+        void forEach(F &&f_)
+        {
+            std::scoped_lock<std::mutex> lock(muxRegistry);
+            for (auto &entry : _dense)
+                f_(entry.conn);
+        }
+
+        // Every connection, for callers working on them without holding the
+        // registry lock. The list is only rebuilt after the membership
+        // changed, so repeated broadcasts share it without allocating.
+        std::shared_ptr<const ConnectionList> snapshot()
+        {
+            std::scoped_lock<std::mutex> lock(muxRegistry);
+            if (!_snapshot)
+            {
+                auto list = std::make_shared<ConnectionList>();
+                list->reserve(_dense.size());
+                for (auto &entry : _dense)
+                    list->push_back(entry.conn);
+                _snapshot = std::move(list);
+            }
+            return _snapshot;
+        }
+
+        size_t count()
+        {
+            std::scoped_lock<std::mutex> lock(muxRegistry);
+            return _dense.size();
+        }
+
+        void clear()
+        {
+            std::scoped_lock<std::mutex> lock(muxRegistry);
+            for (auto &entry : _dense)
+            {
+                _slots[entry.slot].used = false;
+                _slots[entry.slot].generation++;
+                _freeSlots.push_back(entry.slot);
+            }
+            _dense.clear();
+            _idToSlot.clear();
+            _snapshot.reset();
+        }
+
+    protected:
+        bool live(ConnectionHandle handle_) const
+        {
+            if (!handle_.valid() || handle_.slot % _count != _index)
+                return false;
+            const uint32_t slot = handle_.slot / _count;
+            return slot < _slots.size() && _slots[slot].used && _slots[slot].generation == handle_.generation;
+        }
+
+        struct Slot
+        {
+            uint32_t dense = 0;
+            uint32_t generation = 0;
+            bool used = false;
+        };
+
+        struct Entry
+        {
+            std::shared_ptr<Connection<T>> conn;
+            uint32_t slot = 0;
+        };
+
+        uint32_t _index;
+        uint32_t _count;
+        std::mutex muxRegistry;
+        std::vector<Entry> _dense;
+        std::vector<Slot> _slots;
+        std::vector<uint32_t> _freeSlots;
+        std::unordered_map<uint32_t, uint32_t> _idToSlot;
+        // Cached result of snapshot(), dropped on every membership change
+        std::shared_ptr<const ConnectionList> _snapshot;
+    };
+} // qlexnet
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace qlexnet
+{
+    // Runs a handler over submitted items on a pool of worker threads while
+    // keeping items with the same key in submission order.
+    //
+    // Keys are hashed onto a fixed set of partitions, several per worker.
+    // A partition is run by at most one worker at a time, which preserves
+    // per-key order; each partition has a home worker, but an idle worker
+    // steals ready partitions from the others, so one hot key cannot leave
+    // the rest of the pool idle behind it.
+    template <typename Item>
+    class DispatchPool
+    {
+    public:
+        using Handler = std::function<void(Item &)>;
+
+        DispatchPool(size_t workerCount_, Handler handler_, size_t partitionsPerWorker_ = 16)
+            : _handler(std::move(handler_))
+        {
+            workerCount_ = std::max<size_t>(workerCount_, 1);
+            _partitions.resize(workerCount_ * std::max<size_t>(partitionsPerWorker_, 1));
+            _workers.resize(workerCount_);
+
+            for (size_t i = 0; i < workerCount_; i++)
+                _workers[i].thread = std::thread([this, i]()
+                                                 { run(i); });
+        }
+
+        DispatchPool(const DispatchPool<Item> &) = delete;
+        virtual ~DispatchPool() { stop(); }
+
+    public:
+        void submit(uint64_t key_, Item &&item_)
+        {
+            std::scoped_lock<std::mutex> lock(muxPool);
+
+            const size_t p = key_ % _partitions.size();
+            _partitions[p].items.push_back(std::move(item_));
+            _pending++;
+
+            if (!_partitions[p].scheduled)
+            {
+                _partitions[p].scheduled = true;
+                _workers[p % _workers.size()].ready.push_back(p);
+                cvWork.notify_one();
+            }
+        }
+
+        // Block until every submitted item has been handled
+        void waitIdle()
+        {
+            std::unique_lock<std::mutex> ul(muxPool);
+            cvIdle.wait(ul, [this]()
+                        { return _pending == 0; });
+        }
+
+        // Items submitted and not handled yet, including those running
+        size_t pending()
+        {
+            std::scoped_lock<std::mutex> lock(muxPool);
+            return _pending;
+        }
+
+        // Finish the pending items, then join the workers
+        void stop()
+        {
+            {
+                std::scoped_lock<std::mutex> lock(muxPool);
+                if (_stopping)
+                    return;
+                _stopping = true;
+            }
+            cvWork.notify_all();
+
+            for (auto &worker : _workers)
+            {
+                if (worker.thread.joinable())
+                    worker.thread.join();
+            }
+        }
+
+    protected:
+        struct Partition
+        {
+            std::vector<Item> items;
+            bool scheduled = false;
+        };
+
+        struct Worker
+        {
+            std::deque<size_t> ready;
+            std::thread thread;
+        };
+
+        // Own partitions first, oldest first; otherwise steal the newest from a peer
+        bool pick(size_t worker_, size_t &partition_)
+        {
+            if (!_workers[worker_].ready.empty())
+            {
+                partition_ = _workers[worker_].ready.front();
+                _workers[worker_].ready.pop_front();
+                return true;
+            }
+
+            for (size_t i = 1; i < _workers.size(); i++)
+            {
+                auto &victim = _workers[(worker_ + i) % _workers.size()].ready;
+                if (!victim.empty())
+                {
+                    partition_ = victim.back();
+                    victim.pop_back();
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void run(size_t worker_)
+        {
+            // Swapped with a partition's items, so both keep their capacity
+            std::vector<Item> batch;
+
+            std::unique_lock<std::mutex> ul(muxPool);
+            while (true)
+            {
+                size_t p;
+                if (!pick(worker_, p))
+                {
+                    if (_stopping)
+                        break;
+                    cvWork.wait(ul);
+                    continue;
+                }
+
+                std::swap(batch, _partitions[p].items);
+                ul.unlock();
+
+                for (auto &item : batch)
+                    _handler(item);
+                const size_t handled = batch.size();
+                batch.clear();
+
+                ul.lock();
+                _pending -= handled;
+
+                // More arrived meanwhile: go to the back of the line, still scheduled
+                if (!_partitions[p].items.empty())
+                {
+                    _workers[worker_].ready.push_back(p);
+                    cvWork.notify_one();
+                }
+                else
+                {
+                    _partitions[p].scheduled = false;
+                }
+
+                if (_pending == 0)
+                    cvIdle.notify_all();
+            }
+        }
+
+    protected:
+        Handler _handler;
+        std::mutex muxPool;
+        std::condition_variable cvWork;
+        std::condition_variable cvIdle;
+        std::vector<Partition> _partitions;
+        std::vector<Worker> _workers;
+        size_t _pending = 0;
+        bool _stopping = false;
+    };
+} // qlexnet
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory_resource>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "Waiter.h"
+
+namespace qlexnet
+{
+    // Default flow traits for FairQueue: one flow per server connection,
+    // messages cost their wire size.
+    struct ConnectionFlow
+    {
+        template <typename M>
+        static uint64_t key(const M &msg_) { return msg_.handle.slot; }
+
+        template <typename M>
+        static size_t cost(const M &msg_) { return sizeof(msg_.msg.header) + msg_.msg.body.size(); }
+    };
+
+    // roundRobin : each ready flow gives up to `quantum` messages per turn
+    // deficit    : each ready flow earns `quantum` bytes of credit per turn
+    //              and gives messages while it can pay for them (DRR)
+    enum class FairMode
+    {
+        roundRobin,
+        deficit
+    };
+
+    // Rx queue policy with one inbound queue per flow (per connection by
+    // default) and a ready list of the flows holding messages. drain_into()
+    // serves the ready flows in turn, so a client flooding the server only
+    // delays its own messages. Drop it in as the RxQueue of ServerInterface.
+    template <typename T, typename Flow = ConnectionFlow>
+    class FairQueue
+    {
+    public:
+        FairQueue() = default;
+        // Per-flow queue nodes come from resource_, always used under the queue lock
+        explicit FairQueue(std::pmr::memory_resource *resource_) : _resource(resource_) {}
+        FairQueue(const FairQueue<T, Flow> &) = delete;
+        virtual ~FairQueue() { clear(); }
+
+    public:
+        // quantum_ is in messages for roundRobin, in bytes for deficit.
+        // Set it before messages start flowing.
+        void setFairness(FairMode mode_, size_t quantum_)
+        {
+            std::scoped_lock<std::mutex> lock(muxQueue);
+            _mode = mode_;
+            _quantum = std::max<size_t>(quantum_, 1);
+        }
+
+        void push_back(const T &item)
+        {
+            push_back(T(item));
+        }
+
+        void push_back(T &&item)
+        {
+            {
+                std::scoped_lock<std::mutex> lock(muxQueue);
+
+                const uint64_t key = Flow::key(item);
+                auto it = _flowIndex.find(key);
+                if (it == _flowIndex.end())
+                {
+                    it = _flowIndex.emplace(key, _flows.size()).first;
+                    _flows.push_back(FlowQueue{std::pmr::deque<T>(_resource)});
+                }
+
+                FlowQueue &flow = _flows[it->second];
+                flow.items.push_back(std::move(item));
+                if (!flow.ready)
+                {
+                    flow.ready = true;
+                    _ready.push_back(it->second);
+                }
+                _count.fetch_add(1, std::memory_order_release);
+            }
+            _waiter.notify();
+        }
+
+        // Take up to maxItems, visiting the ready flows in turn
+        template <typename Container>
+        size_t drain_into(Container &out, size_t maxItems = -1)
+        {
+            std::scoped_lock<std::mutex> lock(muxQueue);
+
+            size_t n = 0;
+            while (n < maxItems && !_ready.empty())
+            {
+                FlowQueue &flow = _flows[_ready.front()];
+                _ready.pop_front();
+
+                size_t taken = 0;
+                if (_mode == FairMode::deficit)
+                    flow.deficit += _quantum;
+
+                while (n < maxItems && !flow.items.empty())
+                {
+                    if (_mode == FairMode::roundRobin && taken == _quantum)
+                        break;
+
+                    if (_mode == FairMode::deficit)
+                    {
+                        const size_t cost = Flow::cost(flow.items.front());
+                        if (cost > flow.deficit)
+                            break;
+                        flow.deficit -= cost;
+                    }
+
+                    out.push_back(std::move(flow.items.front()));
+                    flow.items.pop_front();
+                    taken++;
+                    n++;
+                }
+
+                if (flow.items.empty())
+                {
+                    // An idle flow does not bank credit
+                    flow.ready = false;
+                    flow.deficit = 0;
+                }
+                else
+                {
+                    _ready.push_back(&flow - _flows.data());
+                }
+            }
+
+            _count.fetch_sub(n, std::memory_order_release);
+            return n;
+        }
+
+        T pop_front()
+        {
+            std::vector<T> one;
+            drain_into(one, 1);
+            return std::move(one.front());
+        }
+
+        bool empty()
+        {
+            return _count.load(std::memory_order_acquire) == 0;
+        }
+
+        size_t count()
+        {
+            return _count.load(std::memory_order_acquire);
+        }
+
+        void clear()
+        {
+            std::scoped_lock<std::mutex> lock(muxQueue);
+            for (auto &flow : _flows)
+            {
+                flow.items.clear();
+                flow.ready = false;
+                flow.deficit = 0;
+            }
+            _ready.clear();
+            _count.store(0, std::memory_order_release);
+        }
+
+        void setWaitStrategy(WaitStrategy strategy_, size_t spinCount_ = 4000)
+        {
+            _waiter.setStrategy(strategy_, spinCount_);
+        }
+
+        void wait()
+        {
+            _waiter.wait([this]()
+                         { return !empty(); });
+        }
+
+        void wait_for(std::chrono::milliseconds timeout)
+        {
+            _waiter.wait_for([this]()
+                             { return !empty(); },
+                             timeout);
+        }
+
+    protected:
+        struct FlowQueue
+        {
+            std::pmr::deque<T> items;
+            size_t deficit = 0;
+            bool ready = false;
+        };
+
+        std::mutex muxQueue;
+        // Flows are never dropped: server slots are recycled, so they stay bounded
+        std::vector<FlowQueue> _flows;
+        std::unordered_map<uint64_t, size_t> _flowIndex;
+        std::deque<size_t> _ready;
+        std::atomic<size_t> _count{0};
+        std::pmr::memory_resource *_resource = std::pmr::get_default_resource();
+        FairMode _mode = FairMode::roundRobin;
+        size_t _quantum = 16;
+        Waiter _waiter;
+    };
+} // qlexnet
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <vector>
+
+#include <asio.hpp>
+
+namespace qlexnet
+{
+    // Handler-sized memory blocks reserved for one connection. Any thread
+    // may take a block (send() posts from the caller's thread) and any
+    // thread may give it back: a bit per block in one atomic word, so there
+    // is no lock and no ABA. Requests that do not fit, or arrive while every
+    // block is taken, are left to the next allocator tier.
+    class HandlerMemory
+    {
+    public:
+        static constexpr size_t blockSize = 512;
+        static constexpr size_t blockCount = 8;
+
+        void *allocate(size_t size_, size_t align_)
+        {
+            if (size_ > blockSize || align_ > alignof(std::max_align_t))
+                return nullptr;
+
+            uint64_t free = _free.load(std::memory_order_relaxed);
+            while (free != 0)
+            {
+                const uint64_t bit = free & (~free + 1);
+                if (_free.compare_exchange_weak(free, free & ~bit, std::memory_order_acquire, std::memory_order_relaxed))
+                    return _blocks[indexOf(bit)].bytes;
+            }
+            return nullptr;
+        }
+
+        bool owns(const void *p_) const
+        {
+            const unsigned char *p = static_cast<const unsigned char *>(p_);
+            return p >= _blocks[0].bytes && p < _blocks[0].bytes + sizeof(_blocks);
+        }
+
+        void deallocate(void *p_)
+        {
+            const size_t index = static_cast<size_t>(static_cast<unsigned char *>(p_) - _blocks[0].bytes) / sizeof(Block);
+            _free.fetch_or(uint64_t(1) << index, std::memory_order_release);
+        }
+
+    private:
+        static size_t indexOf(uint64_t bit_)
+        {
+            size_t index = 0;
+            while (bit_ >>= 1)
+                index++;
+            return index;
+        }
+
+        struct alignas(std::max_align_t) Block
+        {
+            unsigned char bytes[blockSize];
+        };
+
+        static_assert(blockCount <= 64, "One bit per block in a 64-bit word");
+
+        Block _blocks[blockCount];
+        std::atomic<uint64_t> _free{(blockCount == 64) ? ~uint64_t(0) : (uint64_t(1) << blockCount) - 1};
+    };
+
+    // Owns the HandlerMemory of a server's or client's connections and
+    // hands it out again as connections come and go. A handler may still
+    // hold a block after its connection is gone, so the arena must outlive
+    // the io_context: declare it before the context in the owning class.
+    class HandlerArena
+    {
+    public:
+        HandlerArena() = default;
+        HandlerArena(const HandlerArena &) = delete;
+
+        HandlerMemory *acquire()
+        {
+            std::scoped_lock<std::mutex> lock(muxArena);
+            if (_free.empty())
+            {
+                _all.push_back(std::make_unique<HandlerMemory>());
+                return _all.back().get();
+            }
+
+            HandlerMemory *memory = _free.back();
+            _free.pop_back();
+            return memory;
+        }
+
+        void release(HandlerMemory *memory_)
+        {
+            std::scoped_lock<std::mutex> lock(muxArena);
+            _free.push_back(memory_);
+        }
+
+    protected:
+        std::mutex muxArena;
+        std::vector<std::unique_ptr<HandlerMemory>> _all;
+        std::vector<HandlerMemory *> _free;
+    };
+
+    // Allocator bound to a connection's completion handlers (see
+    // asio::bind_allocator). Handler state comes from the connection's
+    // HandlerMemory when it fits, otherwise from the given memory resource,
+    // or without one from asio's per-thread recycling cache, which is what
+    // unbound handlers use.
+    template <typename T>
+    class HandlerAllocator
+    {
+    public:
+        using value_type = T;
+
+        explicit HandlerAllocator(std::pmr::memory_resource *resource_ = nullptr, HandlerMemory *memory_ = nullptr) noexcept
+            : _resource(resource_), _memory(memory_)
+        {
+        }
+
+        template <typename U>
+        HandlerAllocator(const HandlerAllocator<U> &other_) noexcept
+            : _resource(other_.resource()), _memory(other_.memory())
+        {
+        }
+
+        T *allocate(std::size_t n_)
+        {
+            if (_memory)
+            {
+                if (void *p = _memory->allocate(n_ * sizeof(T), alignof(T)))
+                    return static_cast<T *>(p);
+            }
+            if (_resource)
+                return static_cast<T *>(_resource->allocate(n_ * sizeof(T), alignof(T)));
+            return asio::recycling_allocator<T>().allocate(n_);
+        }
+
+        void deallocate(T *p_, std::size_t n_)
+        {
+            if (_memory && _memory->owns(p_))
+                _memory->deallocate(p_);
+            else if (_resource)
+                _resource->deallocate(p_, n_ * sizeof(T), alignof(T));
+            else
+                asio::recycling_allocator<T>().deallocate(p_, n_);
+        }
+
+        std::pmr::memory_resource *resource() const noexcept { return _resource; }
+        HandlerMemory *memory() const noexcept { return _memory; }
+
+        template <typename U>
+        friend bool operator==(const HandlerAllocator &a, const HandlerAllocator<U> &b) noexcept
+        {
+            return a.resource() == b.resource() && a.memory() == b.memory();
+        }
+
+        template <typename U>
+        friend bool operator!=(const HandlerAllocator &a, const HandlerAllocator<U> &b) noexcept { return !(a == b); }
+
+    private:
+        std::pmr::memory_resource *_resource;
+        HandlerMemory *_memory;
+    };
+} // qlexnet
@@ -0,0 +1,242 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <new>
+
+#include "Waiter.h"
+
+namespace qlexnet
+{
+    // Lock-free multi-producer / single-consumer queue (Vyukov style).
+    // Producers only do one atomic exchange per push, the consumer never
+    // blocks them, and they only touch the condition variable when the
+    // consumer is parked. It mirrors the part of XQueue used for rx queues,
+    // so it can be dropped in as the RxQueue of ServerInterface / ClientInterface.
+    //
+    // Nodes are recycled: the consumer hands each one it is done with back
+    // to the producers through a bounded ring, so at a steady rate pushes
+    // allocate nothing. Only a backlog deeper than the ring allocates.
+    //
+    // push_back() and count() may be called from any thread. front(),
+    // pop_front(), empty(), clear(), wait() and wait_for() must only be
+    // called by the consumer.
+    template <typename T>
+    class MPSCQueue
+    {
+    public:
+        // recycledNodes_ is the most nodes kept for reuse, rounded up to a power of two
+        explicit MPSCQueue(size_t recycledNodes_ = 1024)
+            : _head(&_stub), _tail(&_stub)
+        {
+            size_t capacity = 2;
+            while (capacity < recycledNodes_)
+                capacity *= 2;
+            _free = std::make_unique<FreeCell[]>(capacity);
+            _freeMask = capacity - 1;
+            for (size_t i = 0; i < capacity; i++)
+                _free[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        MPSCQueue(const MPSCQueue<T> &) = delete;
+        virtual ~MPSCQueue()
+        {
+            clear();
+            release(_tail);
+            while (Node *node = reuse())
+                delete node;
+        }
+
+    public:
+        void push_back(const T &item)
+        {
+            emplace_back(item);
+        }
+
+        void push_back(T &&item)
+        {
+            emplace_back(std::move(item));
+        }
+
+        template <typename... Args>
+        void emplace_back(Args &&...args)
+        {
+            Node *node = reuse();
+            if (!node)
+                node = new Node;
+            node->next.store(nullptr, std::memory_order_relaxed);
+            try
+            {
+                new (&node->storage) T(std::forward<Args>(args)...);
+            }
+            catch (...)
+            {
+                // Only the consumer may park nodes
+                delete node;
+                throw;
+            }
+            enqueue(node);
+        }
+
+        T &front()
+        {
+            return _tail->next.load(std::memory_order_acquire)->value();
+        }
+
+        T pop_front()
+        {
+            Node *next = _tail->next.load(std::memory_order_acquire);
+            T t = std::move(next->value());
+            // next becomes the new stub, holding no value
+            next->value().~T();
+            release(_tail);
+            _tail = next;
+            _popped.store(_popped.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            return t;
+        }
+
+        template <typename Container>
+        size_t drain_into(Container &out, size_t maxItems = -1)
+        {
+            size_t n = 0;
+            while (n < maxItems && !empty())
+            {
+                out.push_back(pop_front());
+                n++;
+            }
+            return n;
+        }
+
+        // A push that has swapped the head but not linked its node yet is
+        // not visible; it will be on the next call.
+        bool empty()
+        {
+            return _tail->next.load(std::memory_order_acquire) == nullptr;
+        }
+
+        void clear()
+        {
+            while (!empty())
+                pop_front();
+        }
+
+        // Items pushed and not popped yet, a snapshot when producers are running
+        size_t count()
+        {
+            const size_t popped = _popped.load(std::memory_order_acquire);
+            return _pushed.load(std::memory_order_acquire) - popped;
+        }
+
+        void setWaitStrategy(WaitStrategy strategy_, size_t spinCount_ = 4000)
+        {
+            _waiter.setStrategy(strategy_, spinCount_);
+        }
+
+        void wait()
+        {
+            _waiter.wait([this]()
+                         { return !empty(); });
+        }
+
+        void wait_for(std::chrono::milliseconds timeout)
+        {
+            _waiter.wait_for([this]()
+                             { return !empty(); },
+                             timeout);
+        }
+
+    protected:
+        // The value lives in raw storage: it is constructed on push and
+        // destroyed on pop, so the stub and recycled nodes hold none
+        struct Node
+        {
+            alignas(T) unsigned char storage[sizeof(T)];
+            std::atomic<Node *> next{nullptr};
+
+            T &value() { return *std::launder(reinterpret_cast<T *>(&storage)); }
+        };
+
+        void enqueue(Node *node)
+        {
+            _pushed.fetch_add(1, std::memory_order_relaxed);
+            Node *prev = _head.exchange(node, std::memory_order_acq_rel);
+            prev->next.store(node, std::memory_order_release);
+
+            _waiter.notify();
+        }
+
+        // Consumer side: park the node in the free ring, or delete it if the ring is full
+        void release(Node *node)
+        {
+            if (node == &_stub)
+                return;
+
+            FreeCell &cell = _free[_freeTail & _freeMask];
+            if (cell.sequence.load(std::memory_order_acquire) != _freeTail)
+            {
+                delete node;
+                return;
+            }
+            cell.node = node;
+            cell.sequence.store(_freeTail + 1, std::memory_order_release);
+            _freeTail++;
+        }
+
+        // Producer side: take a parked node, nullptr if there is none.
+        // Bounded MPMC ring (Vyukov): a cell's sequence tells whether it
+        // holds a node for this lap, so there is no ABA problem.
+        Node *reuse()
+        {
+            size_t pos = _freeHead.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                FreeCell &cell = _free[pos & _freeMask];
+                const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+                const std::ptrdiff_t lag = static_cast<std::ptrdiff_t>(sequence - (pos + 1));
+                if (lag == 0)
+                {
+                    if (_freeHead.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        Node *node = cell.node;
+                        cell.sequence.store(pos + _freeMask + 1, std::memory_order_release);
+                        return node;
+                    }
+                }
+                else if (lag < 0)
+                {
+                    return nullptr;
+                }
+                else
+                {
+                    pos = _freeHead.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        struct FreeCell
+        {
+            std::atomic<size_t> sequence{0};
+            Node *node = nullptr;
+        };
+
+    protected:
+        Node _stub;
+        // Producers swap themselves in at the head, the consumer walks from the tail
+        std::atomic<Node *> _head;
+        Node *_tail;
+
+        // Recycled nodes: the consumer puts them in at _freeTail, producers
+        // take them from _freeHead
+        std::unique_ptr<FreeCell[]> _free;
+        size_t _freeMask = 0;
+        std::atomic<size_t> _freeHead{0};
+        size_t _freeTail = 0;
+
+        std::atomic<size_t> _pushed{0};
+        std::atomic<size_t> _popped{0};
+
+        Waiter _waiter;
+    };
+} // qlexnet
@@ -1,8 +1,18 @@
 #pragma once
 
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <memory_resource>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
 #include <vector>
 
+#include "ConnectionRegistry.h"
+#include "SmallBuffer.h"
+#include "BufferPool.h"
+
 namespace qlexnet
 {
     template <typename T>
@@ -10,8 +20,61 @@ namespace qlexnet
     {
         T id{};
         uint32_t size = 0;
+        // Request/response pairing for RpcClient, 0 when not a call
+        uint32_t correlation = 0;
+    };
+
+    // Per message-type tuning. Specialize it for your id type, any member
+    // left out keeps its default:
+    //   inlineBody : bodies of up to that many bytes are stored inside the
+    //                Message, so small messages never touch the heap
+    //   pmrBody    : heap storage is a std::pmr::vector<uint8_t>, allocated
+    //                from the memory resource given to the server or client
+    //
+    //   template <> struct qlexnet::MessageTraits<MyMsg> { static constexpr size_t inlineBody = 64; };
+    template <typename T>
+    struct MessageTraits
+    {
+        static constexpr size_t inlineBody = 0;
+        static constexpr bool pmrBody = false;
     };
 
+    template <typename Traits, typename = void>
+    struct InlineBodyOf : std::integral_constant<size_t, 0> {};
+
+    template <typename Traits>
+    struct InlineBodyOf<Traits, std::void_t<decltype(Traits::inlineBody)>> : std::integral_constant<size_t, Traits::inlineBody> {};
+
+    template <typename Traits, typename = void>
+    struct PmrBodyOf : std::false_type {};
+
+    template <typename Traits>
+    struct PmrBodyOf<Traits, std::void_t<decltype(Traits::pmrBody)>> : std::bool_constant<Traits::pmrBody> {};
+
+    // Heap storage of message bodies, and the pool recycling it
+    template <typename T>
+    using BodyBuffer = std::conditional_t<PmrBodyOf<MessageTraits<T>>::value,
+                                          std::pmr::vector<uint8_t>,
+                                          std::vector<uint8_t>>;
+
+    template <typename T>
+    using BodyPool = BasicBufferPool<BodyBuffer<T>>;
+
+    template <typename T>
+    using MessageBody = std::conditional_t<InlineBodyOf<MessageTraits<T>>::value == 0,
+                                           BodyBuffer<T>,
+                                           SmallBuffer<InlineBodyOf<MessageTraits<T>>::value, BodyBuffer<T>>>;
+
+    // Move pooled storage into a body, whichever the body type
+    template <typename T>
+    void adoptBody(MessageBody<T> &body_, BodyBuffer<T> &&buffer_)
+    {
+        if constexpr (std::is_same_v<MessageBody<T>, BodyBuffer<T>>)
+            adoptBuffer(body_, std::move(buffer_));
+        else
+            body_ = std::move(buffer_);
+    }
+
     template <typename T>
     struct Message
     {
@@ -20,7 +83,7 @@ namespace qlexnet
         //          Body should always be composed
         //          by the same data.
         //          All transmisted in binary.
-        std::vector<uint8_t> body;
+        MessageBody<T> body;
 
         size_t size() const
         {
@@ -56,6 +119,30 @@ namespace qlexnet
         }
     };
 
+    // Non-owning view of a received message. It points into connection
+    // buffers and is only valid for the duration of the call it is passed to.
+    template <typename T>
+    struct MessageView
+    {
+        MessageHeader<T> header{};
+        const uint8_t *body = nullptr;
+        size_t length = 0;
+
+        size_t size() const
+        {
+            return length;
+        }
+
+        // Copy out, for when the message must outlive the call
+        Message<T> toMessage() const
+        {
+            Message<T> msg;
+            msg.header = header;
+            msg.body.assign(body, body + length);
+            return msg;
+        }
+    };
+
     template <typename T>
     class Connection;
 
@@ -64,6 +151,9 @@ namespace qlexnet
     {
         std::shared_ptr<Connection<T>> remote = nullptr;
         Message<T> msg;
+        // Always set on the server side; remote is left empty when the
+        // server delivers handles only (see ServerInterface::setHandleDelivery)
+        ConnectionHandle handle{};
 
         // Again, a friendly string maker
         friend std::ostream &operator<<(std::ostream &os, const OwnedMessage<T> &msg)
@@ -73,6 +163,40 @@ namespace qlexnet
         }
     };
 
+    // Immutable, reference-counted wire encoding of a message: the header
+    // immediately followed by the body. It is built once and its buffer is
+    // shared by every tx queue it is sent to, so a broadcast copies the
+    // payload once whatever the number of recipients.
+    template <typename T>
+    class SharedFrame
+    {
+    public:
+        SharedFrame() = default;
+
+        explicit SharedFrame(const Message<T> &msg)
+        {
+            auto bytes = std::make_shared<std::vector<uint8_t>>(sizeof(MessageHeader<T>) + msg.body.size());
+            std::memcpy(bytes->data(), &msg.header, sizeof(MessageHeader<T>));
+            if (!msg.body.empty())
+                std::memcpy(bytes->data() + sizeof(MessageHeader<T>), msg.body.data(), msg.body.size());
+            _bytes = std::move(bytes);
+        }
+
+        MessageHeader<T> header() const
+        {
+            MessageHeader<T> h;
+            std::memcpy(&h, _bytes->data(), sizeof(MessageHeader<T>));
+            return h;
+        }
+
+        const uint8_t *data() const { return _bytes ? _bytes->data() : nullptr; }
+        size_t size() const { return _bytes ? _bytes->size() : 0; }
+        bool empty() const { return size() == 0; }
+
+    private:
+        std::shared_ptr<const std::vector<uint8_t>> _bytes;
+    };
+
     template <typename T>
     class MessageWriter
     {
@@ -110,7 +234,10 @@ namespace qlexnet
     {
     public:
         explicit MessageReader(const Message<T>& msg)
-            : _msg(msg) {}
+            : _data(msg.body.data()), _size(msg.body.size()) {}
+
+        explicit MessageReader(const MessageView<T>& msg)
+            : _data(msg.body), _size(msg.size()) {}
 
         template <typename DataType>
         void read(DataType& out)
@@ -118,10 +245,10 @@ namespace qlexnet
             static_assert(std::is_trivially_copyable_v<DataType>,
                           "DataType must be trivially copyable");
 
-            if (_offset + sizeof(DataType) > _msg.body.size())
+            if (_offset + sizeof(DataType) > _size)
                 throw std::runtime_error("MessageReader overflow");
 
-            std::memcpy(&out, _msg.body.data() + _offset, sizeof(DataType));
+            std::memcpy(&out, _data + _offset, sizeof(DataType));
             _offset += sizeof(DataType);
         }
 
@@ -130,17 +257,18 @@ namespace qlexnet
             uint32_t len;
             read(len);
 
-            if (_offset + len > _msg.body.size())
+            if (_offset + len > _size)
                 throw std::runtime_error("Invalid string length");
 
             std::string s(len, '\0');
-            std::memcpy(s.data(), _msg.body.data() + _offset, len);
+            std::memcpy(s.data(), _data + _offset, len);
             _offset += len;
             return s;
         }
 
     private:
-        const Message<T>& _msg;
+        const uint8_t* _data;
+        size_t _size;
         size_t _offset = 0;
     };
 
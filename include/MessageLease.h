@@ -0,0 +1,76 @@
+#pragma once
+
+#include <utility>
+
+#include "Message.h"
+#include "BufferPool.h"
+
+namespace qlexnet
+{
+    // A message whose body was drawn from a body pool. If the lease ends
+    // with the message still in it, the body goes back to the pool; take()
+    // hands the message on instead, e.g. to send(), and the connection then
+    // recycles the body itself once it has been written.
+    template <typename T>
+    class MessageLease
+    {
+    public:
+        MessageLease() = default;
+
+        MessageLease(BodyPool<T> &pool_, T id_, size_t reserve_ = 0)
+            : _pool(&pool_)
+        {
+            _msg.header.id = id_;
+            adoptBody<T>(_msg.body, pool_.acquire());
+            if (reserve_ > 0)
+                _msg.body.reserve(reserve_);
+        }
+
+        MessageLease(const MessageLease &) = delete;
+        MessageLease &operator=(const MessageLease &) = delete;
+
+        MessageLease(MessageLease &&other_) noexcept
+            : _pool(std::exchange(other_._pool, nullptr)), _msg(std::move(other_._msg))
+        {
+        }
+
+        MessageLease &operator=(MessageLease &&other_) noexcept
+        {
+            if (this != &other_)
+            {
+                reset();
+                _pool = std::exchange(other_._pool, nullptr);
+                _msg = std::move(other_._msg);
+            }
+            return *this;
+        }
+
+        ~MessageLease() { reset(); }
+
+    public:
+        Message<T> &operator*() { return _msg; }
+        Message<T> *operator->() { return &_msg; }
+        const Message<T> &operator*() const { return _msg; }
+        const Message<T> *operator->() const { return &_msg; }
+
+        // Move the message out, ending the lease
+        Message<T> take()
+        {
+            _pool = nullptr;
+            return std::move(_msg);
+        }
+
+        // Give the body back now
+        void reset()
+        {
+            if (_pool)
+                _pool->release(std::move(_msg.body));
+            _pool = nullptr;
+            _msg = Message<T>();
+        }
+
+    private:
+        BodyPool<T> *_pool = nullptr;
+        Message<T> _msg;
+    };
+} // qlexnet
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <deque>
+#include <future>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "Message.h"
+#include "XQueue.h"
+#include "Connection.h"
+#include "Client.h"
+
+namespace qlexnet
+{
+    // Response to request_: same id and correlation, empty body.
+    // Servers answer RpcClient calls with it.
+    template <typename T>
+    Message<T> makeReply(const Message<T> &request_)
+    {
+        Message<T> reply;
+        reply.header.id = request_.header.id;
+        reply.header.correlation = request_.header.correlation;
+        return reply;
+    }
+
+    template <typename T>
+    Message<T> makeReply(const Message<T> &request_, T id_)
+    {
+        Message<T> reply = makeReply(request_);
+        reply.header.id = id_;
+        return reply;
+    }
+
+    // Client issuing requests and matching the responses by correlation ID.
+    // Up to setMaxInFlight() calls are pipelined on the connection, the
+    // others wait in line. Responses are matched on the io thread; frames
+    // which do not answer a call still go to incoming().
+    template <typename T, typename RxQueue = XQueue<OwnedMessage<T>>>
+    class RpcClient : public ClientInterface<T, RxQueue>
+    {
+    public:
+        using CallHandler = asio::any_completion_handler<void(std::error_code, Message<T>)>;
+
+        explicit RpcClient(std::pmr::memory_resource *resource_ = nullptr)
+            : ClientInterface<T, RxQueue>(resource_)
+        {
+            this->setInlineDelivery(true);
+        }
+
+        // Join the io thread before the call state below goes away
+        ~RpcClient() override { this->disconnect(); }
+
+    public:
+        // Maximum number of calls awaiting their response. Set it before connect().
+        void setMaxInFlight(size_t calls_) { _maxInFlight = std::max<size_t>(calls_, 1); }
+
+        // Completes with the response. Works with any asio completion token:
+        // a callback, asio::use_future, or `co_await client.async_call(req)`.
+        template <typename CompletionToken = asio::deferred_t>
+        auto async_call(Message<T> request_, CompletionToken &&token_ = {})
+        {
+            return asio::async_initiate<CompletionToken, void(std::error_code, Message<T>)>(
+                [this](auto handler, Message<T> request)
+                {
+                    asio::post(this->_context,
+                               [this, request = std::move(request), done = CallHandler(std::move(handler))]() mutable
+                               {
+                                   _waiting.push_back({std::move(request), std::move(done)});
+                                   issueCalls();
+                               });
+                },
+                token_, std::move(request_));
+        }
+
+        // Blocking flavour, the future throws if the call fails
+        std::future<Message<T>> call(Message<T> request_)
+        {
+            return async_call(std::move(request_), asio::use_future);
+        }
+
+        // Fail every outstanding and waiting call with operation_aborted,
+        // e.g. after the connection was lost
+        void cancelCalls()
+        {
+            asio::post(this->_context, [this]()
+                       { failCalls(asio::error::operation_aborted); });
+        }
+
+    protected:
+        void onMessageInline(const MessageView<T> &msg_) override
+        {
+            auto it = (msg_.header.correlation != 0) ? _pending.find(msg_.header.correlation) : _pending.end();
+            if (it == _pending.end())
+            {
+                this->incoming().push_back({nullptr, msg_.toMessage()});
+                return;
+            }
+
+            CallHandler done = std::move(it->second);
+            _pending.erase(it);
+            finish(std::move(done), std::error_code(), msg_.toMessage());
+            issueCalls();
+        }
+
+        // Responses to requests the lost connection wrote will never come.
+        // Requests it had not written are back in the send backlog, so
+        // those calls, like the ones still waiting, go out on the next
+        // connection or fail through onSendDropped() if there is none.
+        void onDisconnect(std::error_code ec_) override
+        {
+            std::unordered_set<uint32_t> requeued;
+            this->forEachBacklog([&requeued](const Message<T> &msg)
+                                 { requeued.insert(msg.header.correlation); });
+
+            for (auto it = _pending.begin(); it != _pending.end();)
+            {
+                if (requeued.count(it->first))
+                {
+                    ++it;
+                    continue;
+                }
+                finish(std::move(it->second), ec_, Message<T>());
+                it = _pending.erase(it);
+            }
+            issueCalls();
+        }
+
+        // A request held in the backlog was never sent
+        void onSendDropped(Message<T> &msg_) override
+        {
+            auto it = _pending.find(msg_.header.correlation);
+            if (it != _pending.end())
+            {
+                CallHandler done = std::move(it->second);
+                _pending.erase(it);
+                finish(std::move(done), asio::error::not_connected, Message<T>());
+            }
+            issueCalls();
+        }
+
+    private:
+        struct Call
+        {
+            Message<T> request;
+            CallHandler done;
+        };
+
+        // The rest of the class only runs on the io thread, no locking needed
+        void issueCalls()
+        {
+            while (!_waiting.empty() && _pending.size() < _maxInFlight)
+            {
+                Call call = std::move(_waiting.front());
+                _waiting.pop_front();
+
+                if (++_nextCall == 0)
+                    ++_nextCall;
+                call.request.header.correlation = _nextCall;
+
+                // Held in the client's backlog while it is (re)connecting
+                if (!this->send(std::move(call.request)))
+                {
+                    finish(std::move(call.done), asio::error::not_connected, Message<T>());
+                    continue;
+                }
+                _pending.emplace(_nextCall, std::move(call.done));
+            }
+        }
+
+        void failPending(std::error_code ec_)
+        {
+            for (auto &[id, done] : _pending)
+                finish(std::move(done), ec_, Message<T>());
+            _pending.clear();
+        }
+
+        void failCalls(std::error_code ec_)
+        {
+            failPending(ec_);
+            for (auto &call : _waiting)
+                finish(std::move(call.done), ec_, Message<T>());
+            _waiting.clear();
+        }
+
+        void finish(CallHandler &&done_, std::error_code ec_, Message<T> &&response_)
+        {
+            asio::dispatch(this->_context.get_executor(), asio::append(std::move(done_), ec_, std::move(response_)));
+        }
+
+    private:
+        size_t _maxInFlight = 128;
+        uint32_t _nextCall = 0;
+        std::unordered_map<uint32_t, CallHandler> _pending;
+        std::deque<Call> _waiting;
+    };
+} // qlexnet
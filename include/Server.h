@@ -1,33 +1,90 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <memory>
+#include <memory_resource>
+#include <thread>
 
 #include "Message.h"
 #include "XQueue.h"
+#include "MPSCQueue.h"
+#include "FairQueue.h"
+#include "ConnectionRegistry.h"
+#include "DispatchPool.h"
 #include "Connection.h"
+#include "ConnectionFactory.h"
 
 namespace qlexnet
 {
+    // shared  : one io_context run by every thread, connections spread over strands
+    // sharded : one io_context, thread and acceptor per thread (SO_REUSEPORT),
+    //           each shard owning its connections and rx queue outright
+    enum class ServerMode
+    {
+        shared,
+        sharded
+    };
 
-    template <typename T>
-    class ServerInterface
+    // RxQueue is the queue policy for incoming messages: XQueue by default,
+    // MPSCQueue for a lock-free multi-producer rx path, or FairQueue to
+    // drain connections round-robin.
+    template <typename T, typename RxQueue = XQueue<OwnedMessage<T>>>
+    class ServerInterface : public ConnectionFactory<T>
     {
     public:
-        ServerInterface(uint16_t port_)
-            : _asioAcceptor(_asioContext, asio::ip::tcp::endpoint(asio::ip::tcp::v4(), port_))
+        // threadCount_ threads run the asio context(s). In shared mode each
+        // connection's socket is bound to its own strand, so its handlers
+        // never run concurrently; in sharded mode every shard is single-threaded.
+        // resource_, if given, also backs the rx queues (see ConnectionFactory).
+        ServerInterface(uint16_t port_, size_t threadCount_ = 1, ServerMode mode_ = ServerMode::shared,
+                        std::pmr::memory_resource *resource_ = nullptr)
+            : ConnectionFactory<T>(resource_)
         {
+            threadCount_ = std::max<size_t>(threadCount_, 1);
+            const size_t shardCount = (mode_ == ServerMode::sharded) ? threadCount_ : 1;
+            _threadsPerShard = (mode_ == ServerMode::sharded) ? 1 : threadCount_;
+
+            const asio::ip::tcp::endpoint endpoint(asio::ip::tcp::v4(), port_);
+            for (size_t i = 0; i < shardCount; i++)
+            {
+                auto shard = std::make_unique<Shard>(resource_, static_cast<uint32_t>(i), static_cast<uint32_t>(shardCount));
+                if (shardCount > 1)
+                    shard->anyWaiter = &_rxWaiter;
+
+#if defined(SO_REUSEPORT)
+                shard->acceptor = makeAcceptor(shard->context, endpoint, shardCount > 1);
+#else
+                // No SO_REUSEPORT: the first shard listens for all of them
+                if (i == 0)
+                    shard->acceptor = makeAcceptor(shard->context, endpoint, false);
+#endif
+                _shards.push_back(std::move(shard));
+            }
         }
 
-        virtual ~ServerInterface() { stop(); }
+        virtual ~ServerInterface()
+        {
+            // Too late for the dispatch workers: the derived part holding
+            // onMessage() is already gone (see setDispatchWorkers)
+            if (_dispatchPool && _dispatchPool->pending() > 0)
+                std::cerr << "[SERVER] Destroyed with " << _dispatchPool->pending()
+                          << " messages still dispatching, call stop() in the derived destructor\n";
+            stop();
+        }
 
         bool start()
         {
             try
             {
                 waitForClientConnection();
-                _threadContext = std::thread([this]()
-                                             { _asioContext.run(); });
+                for (auto &shard : _shards)
+                {
+                    for (size_t i = 0; i < _threadsPerShard; i++)
+                        shard->threads.emplace_back([ctx = &shard->context]()
+                                                    { ctx->run(); });
+                }
             }
             catch (std::exception &e)
             {
@@ -40,114 +97,208 @@ namespace qlexnet
 
         void stop()
         {
-            _asioContext.stop();
+            for (auto &shard : _shards)
+                shard->context.stop();
 
-            if (_threadContext.joinable())
-                _threadContext.join();
+            for (auto &shard : _shards)
+            {
+                for (auto &thread : shard->threads)
+                {
+                    if (thread.joinable())
+                        thread.join();
+                }
+                shard->threads.clear();
+            }
+
+#if defined(ASIO_HAS_CO_AWAIT)
+            // A suspended onSession() holds its connection through the
+            // handler it waits on, and nothing will run that handler now
+            for (auto &shard : _shards)
+                shard->connections.forEach([](const std::shared_ptr<Connection<T>> &conn)
+                                           { conn->dropPendingHandlers(); });
+#endif
+
+            // No more input, let the workers finish what they were given.
+            // Called from ~ServerInterface this only reaches the base onMessage().
+            if (_dispatchPool)
+                _dispatchPool->stop();
 
             std::cout << "[SERVER] Stopped!\n";
         }
 
         void waitForClientConnection()
         {
-            _asioAcceptor.async_accept(
-                [this](std::error_code ec, asio::ip::tcp::socket socket)
-                {
-                    if (!ec)
-                    {
-                        std::cout << "[SERVER] New Connection: " << socket.remote_endpoint() << std::endl;
+            for (auto &shard : _shards)
+            {
+                if (shard->acceptor)
+                    waitForClientConnection(*shard);
+            }
+        }
 
-                        std::shared_ptr<Connection<T>> newconn =
-                            std::make_shared<Connection<T>>(Connection<T>::owner::server,
-                                                            _asioContext, std::move(socket), _rxQueue);
+        size_t shardCount() const { return _shards.size(); }
 
-                        if (onClientConnect(newconn))
-                        {
-                            _connections.push_back(std::move(newconn));
-                            _connections.back()->connectToClient(nIDCounter++);
+        // Rx queue of a shard, e.g. to tune its wait strategy or fairness
+        RxQueue &rxQueue(size_t shard_ = 0) { return _shards[shard_]->rxQueue; }
 
-                            std::cout << "[" << _connections.back()->GetID() << "] Connection Approved" << std::endl;
-                        }
-                        else
-                        {
-                            std::cout << "[-----] Connection Denied" << std::endl;
-                        }
-                    }
-                    else
-                    {
-                        std::cout << "[SERVER] New Connection Error: " << ec.message() << "\n";
-                    }
-                    waitForClientConnection();
-                });
+        // When enabled, received messages only carry a ConnectionHandle and
+        // are delivered through onHandleMessage(), so the receive path does no
+        // atomic refcounting. Must be set before start().
+        void setHandleDelivery(bool enable_) { _handleDelivery = enable_; }
+
+        std::shared_ptr<Connection<T>> resolve(ConnectionHandle client_) { return registryOf(client_).resolve(client_); }
+
+        // When enabled, received frames never reach the rx queue: they are
+        // passed to onMessageInline() on the connection's io thread as soon as
+        // they are parsed. Must be set before start().
+        void setInlineDelivery(bool enable_) { _inlineDelivery = enable_; }
+
+#if defined(ASIO_HAS_CO_AWAIT)
+        // When enabled, each approved connection runs onSession() as a
+        // coroutine on its io thread, reading with co_await async_receive()
+        // instead of going through the rx queue. Must be set before start().
+        void setSessionMode(bool enable_) { _sessionMode = enable_; }
+#endif
+
+        // Spread onMessage() over workerCount_ threads. Messages of one
+        // connection stay in order, different connections run in parallel and
+        // update() returns as soon as its batch is handed over.
+        // 0 dispatches on the thread calling update(). Must be set before start().
+        // The workers call onMessage() after update() has returned, so a
+        // derived server must call stop() (or waitDispatchIdle()) in its own
+        // destructor, before the members its onMessage() uses are destroyed.
+        void setDispatchWorkers(size_t workerCount_)
+        {
+            _dispatchPool.reset();
+            if (workerCount_ > 0)
+                _dispatchPool = std::make_unique<DispatchPool<OwnedMessage<T>>>(
+                    workerCount_, [this](OwnedMessage<T> &msg)
+                    { deliver(msg); });
+        }
+
+        // Block until the dispatch workers have handled everything update() gave them
+        void waitDispatchIdle()
+        {
+            if (_dispatchPool)
+                _dispatchPool->waitIdle();
         }
 
         void messageClient(std::shared_ptr<Connection<T>> client_, const Message<T> &msg_)
+        {
+            messageClient(std::move(client_), Message<T>(msg_));
+        }
+
+        void messageClient(std::shared_ptr<Connection<T>> client_, Message<T> &&msg_)
         {
             if (client_ && client_->isConnected())
             {
-                client_->send(msg_);
+                client_->send(std::move(msg_));
             }
             else
             {
                 onClientDisconnect(client_);
-                client_.reset();
-                _connections.erase(
-                    std::remove(_connections.begin(), _connections.end(), client_), _connections.end());
+                if (client_ && client_->GetHandle().valid())
+                    registryOf(client_->GetHandle()).remove(client_->GetID());
             }
         }
 
-        void messageClient(uint32_t id_, const Message<T>& msg_)
+        void messageClient(uint32_t id_, const Message<T> &msg_)
         {
+            messageClient(id_, Message<T>(msg_));
+        }
+
+        void messageClient(uint32_t id_, Message<T> &&msg_)
+        {
+            // IDs are not tied to a shard, ask each until one knows it
             std::shared_ptr<Connection<T>> client;
-            for (const auto& c : _connections) {
-                if (c->GetID() == id_) {
-                    client = c;
-                }
-            }
+            for (size_t i = 0; i < _shards.size() && !client; i++)
+                client = _shards[i]->connections.find(id_);
             if (client == nullptr) return;
 
-            messageClient(client, msg_);
+            messageClient(std::move(client), std::move(msg_));
+        }
+
+        // Unicast without taking ownership of the connection
+        void messageClient(ConnectionHandle client_, Message<T> &&msg_)
+        {
+            bool connected = false;
+            bool live = registryOf(client_).with(client_, [&](Connection<T> &conn)
+                                          {
+                                              connected = conn.isConnected();
+                                              if (connected)
+                                                  conn.send(std::move(msg_)); });
+
+            if (live && !connected)
+                messageClient(resolve(client_), std::move(msg_));
+        }
+
+        void messageClient(ConnectionHandle client_, const Message<T> &msg_)
+        {
+            messageClient(client_, Message<T>(msg_));
         }
 
         void messageAllClients(const Message<T> &msg_, std::shared_ptr<Connection<T>> pIgnoreClient_ = nullptr)
         {
-            bool invalidClientExists = false;
+            // Encode once, every connection queues the same shared buffer
+            messageAllClients(SharedFrame<T>(msg_), pIgnoreClient_);
+        }
 
-            for (auto &client : _connections)
+        void messageAllClients(const SharedFrame<T> &frame_, std::shared_ptr<Connection<T>> pIgnoreClient_ = nullptr)
+        {
+            // Send from a snapshot: the registry lock is only held while
+            // taking it, so accepts on the shard are not held up by the
+            // sends, and onClientDisconnect may message others
+            for (auto &shard : _shards)
             {
-                if (client && client->isConnected())
-                {
-                    if (client != pIgnoreClient_)
-                        client->send(msg_);
-                }
-                else
-                {
-                    onClientDisconnect(client);
-                    client.reset();
+                const auto clients = shard->connections.snapshot();
 
-                    invalidClientExists = true;
+                for (auto &client : *clients)
+                {
+                    if (client->isConnected())
+                    {
+                        if (client != pIgnoreClient_)
+                            client->send(frame_);
+                    }
+                    else
+                    {
+                        onClientDisconnect(client);
+                        shard->connections.remove(client->GetID());
+                    }
                 }
             }
-
-            if (invalidClientExists)
-                _connections.erase(
-                    std::remove(_connections.begin(), _connections.end(), nullptr), _connections.end());
         }
 
+        // Drain every shard, up to maxMessages_ in total
         virtual void update(size_t maxMessages_ = -1, bool wait_ = false, std::chrono::milliseconds timeout = std::chrono::milliseconds(500))
         {
             if (wait_)
-                _rxQueue.wait_for(timeout);
+            {
+                if (_shards.size() == 1)
+                    _shards[0]->rxQueue.wait_for(timeout);
+                else
+                    _rxWaiter.wait_for([this]()
+                                       { return anyMessage(); },
+                                       timeout);
+            }
 
+            // Rotate the starting shard so a small budget does not starve the last ones
             size_t msgCount = 0;
-            while (msgCount < maxMessages_ && !_rxQueue.empty())
+            for (size_t i = 0; i < _shards.size() && msgCount < maxMessages_; i++)
             {
-                auto msg = _rxQueue.pop_front();
+                Shard &shard = *_shards[(_nextShard + i) % _shards.size()];
+                msgCount += dispatch(shard, maxMessages_ - msgCount);
+            }
+            _nextShard = (_nextShard + 1) % _shards.size();
+        }
 
-                onMessage(msg.remote, msg.msg);
+        // Drain a single shard. Shards can be updated from different threads,
+        // onMessage() then runs concurrently for connections of different shards.
+        virtual void updateShard(size_t shard_, size_t maxMessages_ = -1, bool wait_ = false, std::chrono::milliseconds timeout = std::chrono::milliseconds(500))
+        {
+            Shard &shard = *_shards[shard_];
+            if (wait_)
+                shard.rxQueue.wait_for(timeout);
 
-                msgCount++;
-            }
+            dispatch(shard, maxMessages_);
         }
 
     protected:
@@ -155,16 +306,187 @@ namespace qlexnet
         virtual void onClientDisconnect(std::shared_ptr<Connection<T>> client_) {}
         virtual void onMessage(std::shared_ptr<Connection<T>> client_, Message<T> &msg_) {}
 
+#if defined(ASIO_HAS_CO_AWAIT)
+        // Session-mode entry point, one coroutine per connection
+        virtual asio::awaitable<void> onSession(std::shared_ptr<Connection<T>> client_) { co_return; }
+#endif
+
+        // Inline-delivery counterpart of onMessage(), runs on the io thread.
+        // Keep it short: it holds up every other frame of that connection.
+        virtual void onMessageInline(Connection<T> &client_, const MessageView<T> &msg_) {}
+
+        // Handle-delivery counterpart of onMessage(). The default resolves the
+        // handle and forwards, override it to stay off the refcount entirely.
+        virtual void onHandleMessage(ConnectionHandle client_, Message<T> &msg_)
+        {
+            if (auto client = resolve(client_))
+                onMessage(client, msg_);
+        }
+
     protected:
-        XQueue<OwnedMessage<T>> _rxQueue;
-        std::vector<std::shared_ptr<Connection<T>>> _connections;
-        asio::io_context _asioContext;
-        std::thread _threadContext;
+        // One io_context with its threads, acceptor, connections and rx queue.
+        // Shared mode has a single shard run by every thread.
+        struct Shard
+        {
+            Shard(std::pmr::memory_resource *resource_, uint32_t index_, uint32_t count_)
+                : connections(index_, count_), rxQueue(makeQueue<RxQueue>(resource_))
+            {
+            }
 
-        asio::ip::tcp::acceptor _asioAcceptor; // Handles new incoming connection attempts...
+            asio::io_context context;
+            std::unique_ptr<asio::ip::tcp::acceptor> acceptor; // Handles new incoming connection attempts...
+            // Approved connections of this shard. Declared after the context
+            // so sockets go before it.
+            ConnectionRegistry<T> connections;
+            RxQueue rxQueue;
+            // Scratch storage reused by update() for each drained batch
+            std::vector<OwnedMessage<T>> rxBatch;
+            std::vector<std::thread> threads;
+            // Set when sharded, so update() can wait on every shard at once
+            Waiter *anyWaiter = nullptr;
+
+            // Connections deliver here (see MessageSink)
+            void push_back(OwnedMessage<T> &&msg_)
+            {
+                rxQueue.push_back(std::move(msg_));
+                if (anyWaiter)
+                    anyWaiter->notify();
+            }
+        };
+
+        static std::unique_ptr<asio::ip::tcp::acceptor> makeAcceptor(asio::io_context &context_, const asio::ip::tcp::endpoint &endpoint_, bool reusePort_)
+        {
+            auto acceptor = std::make_unique<asio::ip::tcp::acceptor>(context_);
+            acceptor->open(endpoint_.protocol());
+            acceptor->set_option(asio::socket_base::reuse_address(true));
+#if defined(SO_REUSEPORT)
+            // Every shard binds the same port, the kernel spreads new connections
+            if (reusePort_)
+                acceptor->set_option(asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+#endif
+            acceptor->bind(endpoint_);
+            acceptor->listen();
+            return acceptor;
+        }
+
+        void waitForClientConnection(Shard &listener_)
+        {
+            // A shard without its own acceptor gets its connections round-robin
+            Shard &target = (_shards.size() > 1 && !_shards.back()->acceptor)
+                                ? *_shards[_nextAcceptShard++ % _shards.size()]
+                                : listener_;
+
+            // Strands are only needed when several threads run the shard
+            asio::any_io_executor executor = (_threadsPerShard > 1)
+                                                 ? asio::any_io_executor(asio::make_strand(target.context))
+                                                 : asio::any_io_executor(target.context.get_executor());
+
+            listener_.acceptor->async_accept(
+                executor,
+                [this, &listener_, &target](std::error_code ec, asio::ip::tcp::socket socket)
+                {
+                    if (!ec)
+                    {
+                        std::cout << "[SERVER] New Connection: " << socket.remote_endpoint() << std::endl;
+
+                        std::shared_ptr<Connection<T>> newconn =
+                            this->newConnection(Connection<T>::owner::server, target.context, std::move(socket), MessageSink<T>(target));
+
+                        if (onClientConnect(newconn))
+                        {
+                            // Fully set up before publish() lets messageAllClients()
+                            // and other shards' threads reach it
+                            const uint32_t id = nIDCounter++;
+                            const ConnectionHandle handle = target.connections.reserve();
+                            newconn->setHandle(handle, _handleDelivery);
+                            if (_inlineDelivery)
+                                newconn->setInlineHandler([this](Connection<T> &client, const MessageView<T> &msg)
+                                                          { onMessageInline(client, msg); });
+#if defined(ASIO_HAS_CO_AWAIT)
+                            if (_sessionMode)
+                                newconn->enableAsyncReceive();
+#endif
+                            target.connections.publish(handle, id, newconn);
+                            newconn->connectToClient(id);
+#if defined(ASIO_HAS_CO_AWAIT)
+                            if (_sessionMode)
+                                asio::co_spawn(newconn->executor(), onSession(newconn), asio::detached);
+#endif
+
+                            std::cout << "[" << newconn->GetID() << "] Connection Approved" << std::endl;
+                        }
+                        else
+                        {
+                            std::cout << "[-----] Connection Denied" << std::endl;
+                        }
+                    }
+                    else
+                    {
+                        std::cout << "[SERVER] New Connection Error: " << ec.message() << "\n";
+                    }
+                    waitForClientConnection(listener_);
+                });
+        }
+
+        // Registry a handle was issued by, see ConnectionRegistry
+        ConnectionRegistry<T> &registryOf(ConnectionHandle handle_)
+        {
+            return _shards[handle_.slot % _shards.size()]->connections;
+        }
+
+        bool anyMessage()
+        {
+            for (auto &shard : _shards)
+            {
+                if (!shard->rxQueue.empty())
+                    return true;
+            }
+            return false;
+        }
+
+        size_t dispatch(Shard &shard_, size_t maxMessages_)
+        {
+            // Take the whole batch in one go, then dispatch without touching the queue
+            shard_.rxBatch.clear();
+            size_t msgCount = shard_.rxQueue.drain_into(shard_.rxBatch, maxMessages_);
+
+            for (auto &msg : shard_.rxBatch)
+            {
+                // Partition by connection so its messages keep their order
+                if (_dispatchPool)
+                    _dispatchPool->submit(msg.handle.slot, std::move(msg));
+                else
+                    deliver(msg);
+            }
+            shard_.rxBatch.clear();
+            return msgCount;
+        }
+
+        void deliver(OwnedMessage<T> &msg_)
+        {
+            if (msg_.remote)
+                onMessage(msg_.remote, msg_.msg);
+            else
+                onHandleMessage(msg_.handle, msg_.msg);
+            // Received bodies are recycled once onMessage is done
+            this->recycle(msg_.msg);
+        }
+
+    protected:
+        // Woken by every shard's rx queue when there is more than one
+        Waiter _rxWaiter;
+        std::vector<std::unique_ptr<Shard>> _shards;
+        // Optional onMessage() workers, see setDispatchWorkers()
+        std::unique_ptr<DispatchPool<OwnedMessage<T>>> _dispatchPool;
+        size_t _threadsPerShard = 1;
+        size_t _nextShard = 0;
+        size_t _nextAcceptShard = 0;
+        bool _handleDelivery = false;
+        bool _inlineDelivery = false;
+        bool _sessionMode = false;
 
         // Clients will be identified in the "wider system" via an ID
-        uint32_t nIDCounter = 10000;
+        std::atomic<uint32_t> nIDCounter = 10000;
     };
 
-} // qlexnet
\ No newline at end of file
+} // qlexnet
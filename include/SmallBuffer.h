@@ -0,0 +1,199 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace qlexnet
+{
+    // Take over src_'s storage together with its allocator. Move assignment
+    // keeps dst_'s allocator, which for pmr containers on different
+    // resources means copying the contents into dst_'s resource instead.
+    template <typename Buffer>
+    void adoptBuffer(Buffer &dst_, Buffer &&src_)
+    {
+        using Traits = std::allocator_traits<typename Buffer::allocator_type>;
+        if constexpr (Traits::propagate_on_container_move_assignment::value || Traits::is_always_equal::value)
+        {
+            dst_ = std::move(src_);
+        }
+        else
+        {
+            dst_.~Buffer();
+            new (&dst_) Buffer(std::move(src_));
+        }
+    }
+
+    // Byte buffer keeping up to N bytes inside the object itself and only
+    // spilling to a heap vector beyond that. It offers the subset of the
+    // std::vector<uint8_t> interface message bodies use, and adopts or gives
+    // back its heap storage as a plain vector so BufferPool can recycle it.
+    // Once spilled it stays on the heap until released, keeping the capacity.
+    // Heap is the spill vector, std::pmr::vector<uint8_t> for pmr bodies.
+    template <size_t N, typename Heap = std::vector<uint8_t>>
+    class SmallBuffer
+    {
+        static_assert(N > 0, "Use a plain vector for a buffer without inline storage");
+
+    public:
+        SmallBuffer() = default;
+
+        SmallBuffer(const SmallBuffer &other_)
+        {
+            assign(other_.begin(), other_.end());
+        }
+
+        SmallBuffer(SmallBuffer &&other_) noexcept
+        {
+            moveFrom(other_);
+        }
+
+        SmallBuffer(Heap &&heap_) noexcept
+        {
+            *this = std::move(heap_);
+        }
+
+        SmallBuffer &operator=(const SmallBuffer &other_)
+        {
+            if (this != &other_)
+                assign(other_.begin(), other_.end());
+            return *this;
+        }
+
+        SmallBuffer &operator=(SmallBuffer &&other_) noexcept
+        {
+            if (this != &other_)
+                moveFrom(other_);
+            return *this;
+        }
+
+        // Adopt a vector's storage, contents included. An empty, unallocated
+        // vector just resets the buffer to its inline storage.
+        SmallBuffer &operator=(Heap &&heap_) noexcept
+        {
+            adoptBuffer(_heap, std::move(heap_));
+            _onHeap = _heap.capacity() > 0;
+            _size = 0;
+            return *this;
+        }
+
+    public:
+        uint8_t *data() { return _onHeap ? _heap.data() : _inline; }
+        const uint8_t *data() const { return _onHeap ? _heap.data() : _inline; }
+
+        uint8_t *begin() { return data(); }
+        uint8_t *end() { return data() + size(); }
+        const uint8_t *begin() const { return data(); }
+        const uint8_t *end() const { return data() + size(); }
+
+        uint8_t &operator[](size_t i_) { return data()[i_]; }
+        const uint8_t &operator[](size_t i_) const { return data()[i_]; }
+
+        size_t size() const { return _onHeap ? _heap.size() : _size; }
+        size_t capacity() const { return _onHeap ? _heap.capacity() : N; }
+        bool empty() const { return size() == 0; }
+        bool inlined() const { return !_onHeap; }
+
+        // New bytes are zeroed, as with std::vector
+        void resize(size_t size_)
+        {
+            if (_onHeap)
+            {
+                _heap.resize(size_);
+            }
+            else if (size_ <= N)
+            {
+                if (size_ > _size)
+                    std::memset(_inline + _size, 0, size_ - _size);
+                _size = size_;
+            }
+            else
+            {
+                spill(size_);
+                _heap.resize(size_);
+            }
+        }
+
+        void reserve(size_t capacity_)
+        {
+            if (capacity_ > capacity())
+                spill(capacity_);
+        }
+
+        void assign(const uint8_t *first_, const uint8_t *last_)
+        {
+            const size_t size = static_cast<size_t>(last_ - first_);
+            if (!_onHeap && size <= N)
+            {
+                if (size > 0)
+                    std::memmove(_inline, first_, size);
+                _size = size;
+            }
+            else
+            {
+                _heap.assign(first_, last_);
+                _onHeap = true;
+            }
+        }
+
+        void clear()
+        {
+            _heap.clear();
+            _size = 0;
+        }
+
+        // Hand the heap storage over, e.g. to a BufferPool, and go back to
+        // the inline storage. Returns an empty vector when nothing spilled.
+        Heap release()
+        {
+            Heap heap = std::move(_heap);
+            _heap.clear();
+            _onHeap = false;
+            _size = 0;
+            return heap;
+        }
+
+    private:
+        void spill(size_t capacity_)
+        {
+            if (!_onHeap)
+            {
+                _heap.reserve(capacity_);
+                _heap.assign(_inline, _inline + _size);
+                _onHeap = true;
+                _size = 0;
+            }
+            else
+            {
+                _heap.reserve(capacity_);
+            }
+        }
+
+        void moveFrom(SmallBuffer &other_)
+        {
+            if (other_._onHeap)
+            {
+                adoptBuffer(_heap, other_.release());
+                _onHeap = true;
+                _size = 0;
+            }
+            else
+            {
+                clear();
+                _onHeap = false;
+                _size = other_._size;
+                if (_size > 0)
+                    std::memcpy(_inline, other_._inline, _size);
+                other_._size = 0;
+            }
+        }
+
+    private:
+        uint8_t _inline[N];
+        size_t _size = 0;
+        Heap _heap;
+        bool _onHeap = false;
+    };
+} // qlexnet
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
+
+namespace qlexnet
+{
+    // How a consumer waits for a queue to become non-empty.
+    //  park      : sleep on the condition variable straight away (default)
+    //  spin      : busy-poll for the whole timeout, lowest wakeup latency
+    //  spinYield : busy-poll, then keep polling but yield the core
+    //  spinPark  : busy-poll, then sleep on the condition variable
+    enum class WaitStrategy
+    {
+        park,
+        spin,
+        spinYield,
+        spinPark
+    };
+
+    // Consumer-side blocking shared by the queues. Producers call notify()
+    // after publishing an item; it is a single atomic load unless a
+    // consumer is actually parked on the condition variable.
+    class Waiter
+    {
+    public:
+        void setStrategy(WaitStrategy strategy_, size_t spinCount_)
+        {
+            _strategy = strategy_;
+            _spinCount = spinCount_;
+        }
+
+        void notify()
+        {
+            // Pairs with the fence in park(): either the consumer sees the
+            // item, or we see it parked.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (_parked.load(std::memory_order_relaxed) > 0)
+            {
+                std::scoped_lock<std::mutex> lock(muxBlocking);
+                cvBlocking.notify_one();
+            }
+        }
+
+        template <typename Ready>
+        void wait(Ready ready_)
+        {
+            while (!ready_())
+            {
+                if (!spinUntil(ready_, nullptr))
+                    park(ready_, nullptr);
+            }
+        }
+
+        template <typename Ready>
+        void wait_for(Ready ready_, std::chrono::milliseconds timeout_)
+        {
+            const auto deadline = std::chrono::steady_clock::now() + timeout_;
+            if (ready_() || spinUntil(ready_, &deadline))
+                return;
+            park(ready_, &deadline);
+        }
+
+    private:
+        static void cpuRelax()
+        {
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+            _mm_pause();
+#endif
+        }
+
+        static bool expired(const std::chrono::steady_clock::time_point *deadline_)
+        {
+            return deadline_ && std::chrono::steady_clock::now() >= *deadline_;
+        }
+
+        // Returns true when ready, false when the caller should park
+        // (or, for the pure polling strategies, when the deadline passed).
+        template <typename Ready>
+        bool spinUntil(Ready &ready_, const std::chrono::steady_clock::time_point *deadline_)
+        {
+            if (_strategy == WaitStrategy::park)
+                return false;
+
+            for (size_t i = 0; i < _spinCount; i++)
+            {
+                if (ready_())
+                    return true;
+                cpuRelax();
+            }
+
+            if (_strategy == WaitStrategy::spinPark)
+                return false;
+
+            // spin / spinYield keep polling until the deadline
+            for (size_t i = 0;; i++)
+            {
+                if (ready_())
+                    return true;
+
+                if (_strategy == WaitStrategy::spinYield)
+                    std::this_thread::yield();
+                else
+                    cpuRelax();
+
+                // Reading the clock is not free, only look every so often
+                if ((i & 63) == 63 && expired(deadline_))
+                    return true;
+            }
+        }
+
+        template <typename Ready>
+        void park(Ready &ready_, const std::chrono::steady_clock::time_point *deadline_)
+        {
+            std::unique_lock<std::mutex> ul(muxBlocking);
+            _parked.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            if (deadline_)
+                cvBlocking.wait_until(ul, *deadline_, ready_);
+            else
+                cvBlocking.wait(ul, ready_);
+
+            _parked.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+    private:
+        WaitStrategy _strategy = WaitStrategy::park;
+        size_t _spinCount = 4000;
+        std::atomic<int> _parked{0};
+        std::condition_variable cvBlocking;
+        std::mutex muxBlocking;
+    };
+} // qlexnet
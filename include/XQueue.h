@@ -1,7 +1,14 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <mutex>
 #include <deque>
+#include <iterator>
+#include <memory_resource>
+
+#include "Waiter.h"
 
 namespace qlexnet
 {
@@ -9,7 +16,9 @@ namespace qlexnet
     class XQueue
     {
     public:
-        XQueue() = default;
+        XQueue() : deqQueue(&_nodes) {}
+        // Queue nodes come from resource_, always used under the queue lock
+        explicit XQueue(std::pmr::memory_resource *resource_) : _nodes(resource_), deqQueue(&_nodes) {}
         XQueue(const XQueue<T> &) = delete;
         virtual ~XQueue() { clear(); }
 
@@ -31,6 +40,7 @@ namespace qlexnet
             std::scoped_lock<std::mutex> lock(muxQueue);
             auto t = std::move(deqQueue.front());
             deqQueue.pop_front();
+            _count.store(deqQueue.size(), std::memory_order_release);
             return t;
         }
 
@@ -39,66 +49,118 @@ namespace qlexnet
             std::scoped_lock<std::mutex> lock(muxQueue);
             auto t = std::move(deqQueue.back());
             deqQueue.pop_back();
+            _count.store(deqQueue.size(), std::memory_order_release);
             return t;
         }
 
         void push_back(const T &item)
         {
-            std::scoped_lock<std::mutex> lock(muxQueue);
-            deqQueue.emplace_back(std::move(item));
+            {
+                std::scoped_lock<std::mutex> lock(muxQueue);
+                deqQueue.emplace_back(item);
+                _count.store(deqQueue.size(), std::memory_order_release);
+            }
+            _waiter.notify();
+        }
+
+        void push_back(T &&item)
+        {
+            {
+                std::scoped_lock<std::mutex> lock(muxQueue);
+                deqQueue.emplace_back(std::move(item));
+                _count.store(deqQueue.size(), std::memory_order_release);
+            }
+            _waiter.notify();
+        }
 
-            std::unique_lock<std::mutex> ul(muxBlocking);
-            cvBlocking.notify_one();
+        template <typename... Args>
+        void emplace_back(Args &&...args)
+        {
+            {
+                std::scoped_lock<std::mutex> lock(muxQueue);
+                deqQueue.emplace_back(std::forward<Args>(args)...);
+                _count.store(deqQueue.size(), std::memory_order_release);
+            }
+            _waiter.notify();
         }
 
         void push_front(const T &item)
         {
-            std::scoped_lock<std::mutex> lock(muxQueue);
-            deqQueue.emplace_front(std::move(item));
+            {
+                std::scoped_lock<std::mutex> lock(muxQueue);
+                deqQueue.emplace_front(item);
+                _count.store(deqQueue.size(), std::memory_order_release);
+            }
+            _waiter.notify();
+        }
 
-            std::unique_lock<std::mutex> ul(muxBlocking);
-            cvBlocking.notify_one();
+        void push_front(T &&item)
+        {
+            {
+                std::scoped_lock<std::mutex> lock(muxQueue);
+                deqQueue.emplace_front(std::move(item));
+                _count.store(deqQueue.size(), std::memory_order_release);
+            }
+            _waiter.notify();
         }
 
-        bool empty()
+        // Move up to maxItems from the front into out under a single lock
+        template <typename Container>
+        size_t drain_into(Container &out, size_t maxItems = -1)
         {
             std::scoped_lock<std::mutex> lock(muxQueue);
-            return deqQueue.empty();
+            size_t n = std::min(maxItems, deqQueue.size());
+            std::move(deqQueue.begin(), deqQueue.begin() + n, std::back_inserter(out));
+            deqQueue.erase(deqQueue.begin(), deqQueue.begin() + n);
+            _count.store(deqQueue.size(), std::memory_order_release);
+            return n;
+        }
+
+        // Lock-free snapshot, cheap enough to busy-poll
+        bool empty()
+        {
+            return _count.load(std::memory_order_acquire) == 0;
         }
 
         size_t count()
         {
-            std::scoped_lock<std::mutex> lock(muxQueue);
-            return deqQueue.size();
+            return _count.load(std::memory_order_acquire);
         }
 
         void clear()
         {
             std::scoped_lock<std::mutex> lock(muxQueue);
             deqQueue.clear();
+            _count.store(0, std::memory_order_release);
+        }
+
+        // Select how wait()/wait_for() block. Set it before consumers start waiting.
+        void setWaitStrategy(WaitStrategy strategy_, size_t spinCount_ = 4000)
+        {
+            _waiter.setStrategy(strategy_, spinCount_);
         }
 
         void wait()
         {
-            while (empty())
-            {
-                std::unique_lock<std::mutex> ul(muxBlocking);
-                cvBlocking.wait(ul);
-            }
+            _waiter.wait([this]()
+                         { return !empty(); });
         }
 
         void wait_for(std::chrono::milliseconds timeout)
         {
-            std::unique_lock<std::mutex> ul(muxBlocking);
-            cvBlocking.wait_for(ul, timeout, [this](){
-                return !empty();
-            });
+            _waiter.wait_for([this]()
+                             { return !empty(); },
+                             timeout);
         }
 
     protected:
         std::mutex muxQueue;
-        std::deque<T> deqQueue;
-        std::condition_variable cvBlocking;
-        std::mutex muxBlocking;
+        // Recycles the blocks deqQueue frees as it drains, so a queue at
+        // steady load allocates nothing; only used under muxQueue
+        std::pmr::unsynchronized_pool_resource _nodes;
+        std::pmr::deque<T> deqQueue;
+        // Mirrors deqQueue.size(), written under muxQueue, read without it
+        std::atomic<size_t> _count{0};
+        Waiter _waiter;
     };
-} // qlexnet
\ No newline at end of file
+} // qlexnet
@@ -1,7 +1,20 @@
 #pragma once
 
 #include "Message.h"
+#include "Waiter.h"
 #include "XQueue.h"
+#include "MPSCQueue.h"
+#include "FairQueue.h"
+#include "SmallBuffer.h"
+#include "BufferPool.h"
+#include "MessageLease.h"
+#include "HandlerAllocator.h"
+#include "AllocCounter.h"
 #include "Connection.h"
+#include "ConnectionFactory.h"
+#include "ConnectionRegistry.h"
+#include "DispatchPool.h"
 #include "Client.h"
+#include "ClientPool.h"
+#include "Rpc.h"
 #include "Server.h"